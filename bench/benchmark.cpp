@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+#include "GML.hpp"
+
+using namespace std::literals::string_literals;
+
+// Every heap allocation made by the process is counted, so each benchmark can report its own share.
+// Threaded benchmarks allocate from their workers too, hence the atomics.
+static std::atomic<size_t> allocation_count = 0;
+static std::atomic<size_t> allocation_bytes = 0;
+
+static void* counted_alloc(size_t size, size_t alignment = 0) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+  size = size ? size : 1;
+  // aligned_alloc wants a size that is a multiple of the alignment
+  void* ptr = alignment ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment) : std::malloc(size);
+  if(ptr)
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void* operator new(size_t size) { return counted_alloc(size); }
+void* operator new[](size_t size) { return counted_alloc(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return counted_alloc(size, size_t(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return counted_alloc(size, size_t(alignment)); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+struct BENCH_CONFIG {
+  size_t rows = 10000;
+  size_t columns = 8;
+  size_t classes = 3;
+  size_t cardinality = 16; // Distinct values of every categorical column
+  size_t repeat = 5;
+  unsigned seed = 42;
+  bool json = true;
+  std::string filter; // Only benchmarks whose name contains this run
+};
+
+struct BENCH_RESULT {
+  std::string name;
+  std::string dataset;
+  size_t rows; // Rows processed by one run
+  double ns_per_op; // Median over the repeats
+  double allocs_per_op;
+  double bytes_per_op;
+};
+
+// Keeps results observable so the optimizer cannot drop the measured calls
+static volatile size_t sink = 0;
+
+// Numeric features with a label driven by the first two columns and 10% label noise
+GML::TDATA_COL<double> numeric_data(const BENCH_CONFIG& config, std::mt19937& rng) {
+  std::uniform_real_distribution<double> value(0.0, 1.0);
+  std::uniform_int_distribution<size_t> any_class(0, config.classes - 1);
+  GML::TDATA_COL<double> tdatacol;
+  tdatacol.reserve(config.rows);
+
+  for(size_t i = 0; i < config.rows; ++i) {
+    std::vector<double> features(config.columns);
+    for(double& feature : features)
+      feature = value(rng);
+
+    double signal = config.columns > 1 ? (features[0] + features[1]) / 2 : features[0];
+    size_t class_id = std::min<size_t>(signal * config.classes, config.classes - 1);
+    if(value(rng) < 0.1)
+      class_id = any_class(rng);
+
+    tdatacol.push_back({"C"s + std::to_string(class_id), std::move(features)});
+  }
+  return tdatacol;
+}
+
+// Categorical features drawn from config.cardinality strings per column, label driven by the first column
+GML::TDATA_COL<std::string> categorical_data(const BENCH_CONFIG& config, std::mt19937& rng) {
+  std::uniform_int_distribution<size_t> category(0, config.cardinality - 1);
+  std::uniform_int_distribution<size_t> any_class(0, config.classes - 1);
+  std::uniform_real_distribution<double> noise(0.0, 1.0);
+  GML::TDATA_COL<std::string> tdatacol;
+  tdatacol.reserve(config.rows);
+
+  for(size_t i = 0; i < config.rows; ++i) {
+    std::vector<size_t> ids(config.columns);
+    std::vector<std::string> features;
+    for(size_t& id : ids) {
+      id = category(rng);
+      features.push_back("category_"s + std::to_string(id));
+    }
+
+    size_t class_id = (ids[0] * 7 + (config.columns > 1 ? ids[1] : 0)) % config.classes;
+    if(noise(rng) < 0.1)
+      class_id = any_class(rng);
+
+    tdatacol.push_back({"C"s + std::to_string(class_id), std::move(features)});
+  }
+  return tdatacol;
+}
+
+BENCH_RESULT measure(const BENCH_CONFIG& config, std::string name, std::string dataset, const std::function<size_t()>& run) {
+  run(); // Warm-up
+
+  std::vector<double> times;
+  size_t rows = 0, allocations = 0, bytes = 0;
+
+  for(size_t r = 0; r < config.repeat; ++r) {
+    size_t allocations_before = allocation_count, bytes_before = allocation_bytes;
+    auto start = std::chrono::steady_clock::now();
+    rows = run();
+    auto stop = std::chrono::steady_clock::now();
+
+    allocations += allocation_count - allocations_before;
+    bytes += allocation_bytes - bytes_before;
+    times.push_back(std::chrono::duration<double, std::nano>(stop - start).count());
+  }
+
+  std::sort(times.begin(), times.end());
+  return {name, dataset, rows, times[times.size() / 2], (double) allocations / config.repeat, (double) bytes / config.repeat};
+}
+
+template<typename T>
+void run_suite(const BENCH_CONFIG& config, const std::string& dataset_name, const GML::TDATA_COL<T>& tdatacol, std::vector<BENCH_RESULT>& results) {
+  auto selected = [&](const std::string& name) {
+    return config.filter.empty() || (name + "/" + dataset_name).find(config.filter) != std::string::npos;
+  };
+
+  GML::DATASET<T> dataset(tdatacol);
+  std::vector<size_t> rows(dataset.size());
+  std::iota(rows.begin(), rows.end(), 0);
+  auto [_gain, question] = GML::find_best_split(dataset, rows);
+
+  if(selected("gini"))
+    results.push_back(measure(config, "gini", dataset_name, [&] {
+      sink = sink + (GML::gini(tdatacol) > 0.5);
+      return tdatacol.size();
+    }));
+
+  if(selected("partition"))
+    results.push_back(measure(config, "partition", dataset_name, [&] {
+      auto [true_rows, false_rows] = GML::partition(tdatacol, question);
+      sink = sink + true_rows.size();
+      return tdatacol.size();
+    }));
+
+  if(selected("partition_index"))
+    results.push_back(measure(config, "partition_index", dataset_name, [&] {
+      auto [true_rows, false_rows] = GML::partition(dataset, rows, question);
+      sink = sink + true_rows.size();
+      return rows.size();
+    }));
+
+  if(selected("find_best_split"))
+    results.push_back(measure(config, "find_best_split", dataset_name, [&] {
+      sink = sink + GML::find_best_split(dataset, rows).second.column();
+      return rows.size();
+    }));
+
+  GML::TDATA_COL<T> training_data(tdatacol);
+  if(selected("tree_fit"))
+    results.push_back(measure(config, "tree_fit", dataset_name, [&] {
+      GML::TREE<T> tree(training_data);
+      sink = sink + tree.node_count();
+      return training_data.size();
+    }));
+
+  if(selected("tree_fit_presort"))
+    results.push_back(measure(config, "tree_fit_presort", dataset_name, [&] {
+      GML::TREE<T> tree(training_data, GML::TREE_OPTIONS{.presort = true});
+      sink = sink + tree.node_count();
+      return training_data.size();
+    }));
+
+  if(selected("tree_fit_subsample"))
+    results.push_back(measure(config, "tree_fit_subsample", dataset_name, [&] {
+      GML::TREE<T> tree(training_data, GML::TREE_OPTIONS{.subsample = 0.5, .colsample_bynode = 0.5, .seed = config.seed});
+      sink = sink + tree.node_count();
+      return training_data.size();
+    }));
+
+  if(selected("tree_fit_bundled"))
+    results.push_back(measure(config, "tree_fit_bundled", dataset_name, [&] {
+      GML::TREE<T> tree(training_data, GML::TREE_OPTIONS{.bundle_features = true});
+      sink = sink + tree.node_count();
+      return training_data.size();
+    }));
+
+  if(selected("tree_fit_entropy"))
+    results.push_back(measure(config, "tree_fit_entropy", dataset_name, [&] {
+      GML::TREE<T, GML::NO_PROFILE, GML::ENTROPY> tree(training_data);
+      sink = sink + tree.node_count();
+      return training_data.size();
+    }));
+
+  if(selected("tree_fit_multiway"))
+    results.push_back(measure(config, "tree_fit_multiway", dataset_name, [&] {
+      GML::TREE<T> tree(training_data, GML::TREE_OPTIONS{.mode = GML::MULTIPLE});
+      sink = sink + tree.node_count();
+      return training_data.size();
+    }));
+
+  if(selected("tree_fit_mse")) {
+    // Class ids as targets, so regression grows a tree of the same shape
+    std::vector<double> targets(dataset.labels.begin(), dataset.labels.end());
+    results.push_back(measure(config, "tree_fit_mse", dataset_name, [&] {
+      GML::TREE<T, GML::NO_PROFILE, GML::MSE> tree(training_data, targets);
+      sink = sink + tree.node_count();
+      return training_data.size();
+    }));
+  }
+
+  if(selected("hoeffding_update"))
+    results.push_back(measure(config, "hoeffding_update", dataset_name, [&] {
+      GML::HOEFFDING_TREE<T> stream;
+      for(const auto& tdata : tdatacol)
+        stream.update(tdata);
+      sink = sink + stream.node_count();
+      return tdatacol.size();
+    }));
+
+  if(selected("tree_fit_profiled"))
+    results.push_back(measure(config, "tree_fit_profiled", dataset_name, [&] {
+      GML::TREE<T, GML::TRAIN_PROFILE> tree(training_data);
+      sink = sink + tree.train_stats().candidates;
+      return training_data.size();
+    }));
+
+  if(selected("predict")) {
+    GML::TREE<T> tree(training_data);
+    results.push_back(measure(config, "predict", dataset_name, [&] {
+      for(const auto& tdata : tdatacol)
+        sink = sink + tree.predict(tdata).id();
+      return tdatacol.size();
+    }));
+  }
+
+  if(selected("predict_span")) {
+    GML::TREE<T> tree(training_data);
+    results.push_back(measure(config, "predict_span", dataset_name, [&] {
+      for(const auto& tdata : tdatacol)
+        sink = sink + tree.predict_class(std::span<const T>(tdata));
+      return tdatacol.size();
+    }));
+  }
+
+  if(selected("predict_handle")) {
+    GML::MODEL_HANDLE<GML::TREE<T>> handle{GML::TREE<T>(training_data)};
+    results.push_back(measure(config, "predict_handle", dataset_name, [&] {
+      for(const auto& tdata : tdatacol)
+        sink = sink + handle.read([&](const GML::TREE<T>& tree) { return tree.predict_class(std::span<const T>(tdata)); });
+      return tdatacol.size();
+    }));
+  }
+
+  if(selected("predict_multiway")) {
+    GML::TREE<T> tree(training_data, GML::TREE_OPTIONS{.mode = GML::MULTIPLE});
+    results.push_back(measure(config, "predict_multiway", dataset_name, [&] {
+      for(const auto& tdata : tdatacol)
+        sink = sink + tree.predict_class(std::span<const T>(tdata));
+      return tdatacol.size();
+    }));
+  }
+
+  if(selected("predict_batch")) {
+    GML::TREE<T> tree(training_data);
+    std::vector<size_t> row_classes(tdatacol.size());
+    results.push_back(measure(config, "predict_batch", dataset_name, [&] {
+      tree.predict_class(tdatacol, row_classes, 0);
+      sink = sink + row_classes.back();
+      return tdatacol.size();
+    }));
+  }
+
+  if(selected("permutation")) {
+    GML::TREE<T> tree(training_data);
+    results.push_back(measure(config, "permutation", dataset_name, [&] {
+      sink = sink + tree.permutation_importance(tdatacol, {}, 1).size();
+      return tdatacol.size();
+    }));
+  }
+
+  if(selected("shap")) {
+    GML::TREE<T> tree(training_data, GML::TREE_OPTIONS{.max_depth = 8});
+    std::vector<double> contributions(tdatacol.size() * (tdatacol.front().size() + 1) * tree.shap_outputs());
+    results.push_back(measure(config, "shap", dataset_name, [&] {
+      tree.shap_values(tdatacol, contributions, 0);
+      sink = sink + (contributions.back() > 0);
+      return tdatacol.size();
+    }));
+  }
+
+  if(selected("predict_profiled")) {
+    GML::TREE<T, GML::PREDICT_PROFILE> tree(training_data);
+    results.push_back(measure(config, "predict_profiled", dataset_name, [&] {
+      for(const auto& tdata : tdatacol)
+        sink = sink + tree.predict(tdata).id();
+      return tdatacol.size();
+    }));
+  }
+}
+
+void report(const BENCH_CONFIG& config, const std::vector<BENCH_RESULT>& results) {
+  if(!config.json)
+    printf("%-18s %-12s %12s %12s %14s %12s %14s\n", "benchmark", "dataset", "ns/op", "ns/row", "rows/s", "allocs/op", "bytes/op");
+
+  for(const auto& result : results) {
+    double ns_per_row = result.ns_per_op / std::max<size_t>(result.rows, 1);
+    double rows_per_s = 1e9 / ns_per_row;
+
+    if(config.json)
+      printf("{\"benchmark\": \"%s\", \"dataset\": \"%s\", \"rows\": %zu, \"columns\": %zu, \"classes\": %zu, "
+          "\"cardinality\": %zu, \"ns_per_op\": %.1f, \"ns_per_row\": %.3f, \"rows_per_s\": %.1f, "
+          "\"allocs_per_op\": %.1f, \"bytes_per_op\": %.1f}\n",
+          result.name.c_str(), result.dataset.c_str(), result.rows, config.columns, config.classes, 
+          config.cardinality, result.ns_per_op, ns_per_row, rows_per_s, result.allocs_per_op, result.bytes_per_op);
+    else
+      printf("%-18s %-12s %12.0f %12.3f %14.0f %12.1f %14.0f\n", 
+          result.name.c_str(), result.dataset.c_str(), result.ns_per_op, ns_per_row, rows_per_s, result.allocs_per_op, result.bytes_per_op);
+  }
+}
+
+int main(int argc, char** argv) {
+  BENCH_CONFIG config;
+
+  for(int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto value = [&](const std::string& flag) { return arg.substr(flag.size()); };
+
+    if(arg.rfind("--rows=", 0) == 0) config.rows = std::stoul(value("--rows="));
+    else if(arg.rfind("--columns=", 0) == 0) config.columns = std::stoul(value("--columns="));
+    else if(arg.rfind("--classes=", 0) == 0) config.classes = std::stoul(value("--classes="));
+    else if(arg.rfind("--cardinality=", 0) == 0) config.cardinality = std::stoul(value("--cardinality="));
+    else if(arg.rfind("--repeat=", 0) == 0) config.repeat = std::stoul(value("--repeat="));
+    else if(arg.rfind("--seed=", 0) == 0) config.seed = std::stoul(value("--seed="));
+    else if(arg.rfind("--filter=", 0) == 0) config.filter = value("--filter=");
+    else if(arg == "--text") config.json = false;
+    else {
+      fprintf(stderr, 
+          "usage: %s [--rows=N] [--columns=N] [--classes=N] [--cardinality=N] [--repeat=N] [--seed=N] [--filter=NAME] [--text]\n", 
+          argv[0]);
+      return 1;
+    }
+  }
+
+  if(!config.rows || !config.columns || !config.classes || !config.cardinality || !config.repeat) {
+    fprintf(stderr, "rows, columns, classes, cardinality and repeat must be positive\n");
+    return 1;
+  }
+
+  std::mt19937 rng(config.seed);
+  std::vector<BENCH_RESULT> results;
+
+  run_suite(config, "numeric", numeric_data(config, rng), results);
+  run_suite(config, "categorical", categorical_data(config, rng), results);
+
+  report(config, results);
+  return 0;
+}
@@ -7,16 +7,397 @@
 #include <unordered_map>
 #include <memory>
 #include <cmath>
+#include <type_traits>
+#include <limits>
+#include <tuple>
+#include <algorithm>
+#include <numeric>
+#include <variant>
+#include <cstdint>
+#include <bit>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <array>
+#include <span>
+#include <random>
+#include <concepts>
+#include <numbers>
+#include <thread>
+#include <functional>
+#include <stdexcept>
 
 namespace GML {
 enum COND {EQ, NEQ, LT, LTE, GT, GTE};
 enum MODE {BINARY, RANKED, MULTIPLE};
 
 using CLASS_COUNT = std::unordered_map<std::string, size_t>; // All classifier total amount inside a TDATA
-using PRES_CONFIDENCE = std::unordered_map<std::string, std::string>; // Prediction Result Confidence
+using PRES_CONFIDENCE = std::unordered_map<std::string, float>; // Prediction Result Confidence, by class name
+
+// Per-column feature types for mixed rows
+enum COLTYPE {FLOAT, INT, CATEGORY, STRING};
+enum class CATEGORY_ID : uint32_t {};
+
+constexpr CATEGORY_ID UNKNOWN_CATEGORY{std::numeric_limits<uint32_t>::max()}; // Strings never seen in training
+
+using FEATURE = std::variant<double, int64_t, CATEGORY_ID, std::string>; // Alternative index is the COLTYPE
+using SCHEMA = std::vector<COLTYPE>;
+using COLUMN = std::variant<std::vector<double>, std::vector<int64_t>, std::vector<CATEGORY_ID>>; // STRING columns are stored encoded
+
+// Training storage of one column: a plain vector when every row shares T, a typed COLUMN for FEATURE rows.
+// Strings are dictionary-encoded at load time, so string columns are stored as category ids.
+template<typename T> struct COLUMN_STORAGE { using type = std::vector<T>; };
+template<> struct COLUMN_STORAGE<std::string> { using type = std::vector<CATEGORY_ID>; };
+template<> struct COLUMN_STORAGE<FEATURE> { using type = COLUMN; };
+
+// Feature type of a row after its strings went through the training dictionaries
+template<typename T> struct ENCODING { using type = T; };
+template<> struct ENCODING<std::string> { using type = CATEGORY_ID; };
+
+// Maps the strings of one column to dense category ids
+struct DICTIONARY {
+  std::unordered_map<std::string, CATEGORY_ID> ids;
+  std::vector<std::string> names;
+
+  CATEGORY_ID encode(const std::string& name); // Adds unseen names
+  CATEGORY_ID find(const std::string& name) const; // UNKNOWN_CATEGORY for unseen names
+  size_t size() const { return names.size(); }
+};
+
+// Bitset over category ids, used by membership questions
+struct CATEGORY_SET {
+  std::vector<uint64_t> bits;
+
+  void insert(CATEGORY_ID id);
+  bool contains(CATEGORY_ID id) const {
+    size_t i = static_cast<size_t>(id);
+    return i / 64 < bits.size() && (bits[i / 64] >> (i % 64)) & 1;
+  }
+  bool empty() const { return bits.empty(); }
+  size_t size() const;
+};
+
+inline std::ostream& operator<<(std::ostream& out, CATEGORY_ID id);
+inline std::ostream& operator<<(std::ostream& out, const FEATURE& feature);
+
+// Settings used while growing a TREE. The defaults grow the tree until no split has a positive gain.
+struct TREE_OPTIONS {
+  size_t max_depth = std::numeric_limits<size_t>::max(); // Root sits at depth 0
+  size_t min_samples_split = 2; // Nodes with fewer rows become leaves
+  size_t min_samples_leaf = 1; // Splits leaving fewer rows on either side are never considered
+  double min_impurity_decrease = 0.0; // Minimum gain weighted by the fraction of training weight reaching the node
+  size_t max_nodes = std::numeric_limits<size_t>::max(); // Budget is spent in depth-first order
+  size_t max_category_orderings = 8; // Multiclass subset search sorts categories by at most this many classes
+  enum MODE mode = BINARY; // MULTIPLE also gives categorical columns one child per category, through a lookup table
+  size_t max_branches = 16; // MULTIPLE splits nodes holding at most this many categories of the column
+  bool presort = false; // Sort arithmetic columns once per fit instead of at every node, for one row list per column
+  bool bundle_features = false; // Search arithmetic columns that are never nonzero together as one bundle
+  std::unordered_map<std::string, double> class_weights{}; // Multiplies the weight of every row of a class; missing classes weigh 1
+
+  // Subsampling draws without replacement from the engine seeded by seed, so equal options grow equal trees.
+  // Column fractions nest: each level draws from the tree's columns, each node from its level's.
+  double subsample = 1.0; // Fraction of the rows the tree is trained on
+  double colsample_bytree = 1.0;
+  double colsample_bylevel = 1.0;
+  double colsample_bynode = 1.0;
+  size_t max_features = std::numeric_limits<size_t>::max(); // Columns searched at each node, after the fractions
+  uint64_t seed = 0;
+
+  // Trained trees keep only what prediction reads. This also keeps a copy of the rows for NODE_DATA::tdatacol().
+  bool keep_training_data = false;
+
+  bool subsampled() const {
+    return subsample < 1.0 || colsample_bytree < 1.0 || colsample_bylevel < 1.0 || colsample_bynode < 1.0
+      || max_features != std::numeric_limits<size_t>::max();
+  }
+};
+
+// Settings of a HOEFFDING_TREE. A leaf looks for a split every grace_period rows of weight, and splits when its
+// best question beats the best one of every other column, or not splitting, by more than the Hoeffding bound
+// at split_confidence, or when the bound shrinks under tie_threshold because both are about as good.
+struct HOEFFDING_OPTIONS {
+  double grace_period = 200;
+  double split_confidence = 1e-7; // Chance that a split differs from the one infinite data would choose
+  double tie_threshold = 0.05;
+  size_t max_bins = 32; // Thresholds kept per arithmetic column of a leaf, merging the closest; categories past it go unseen
+  size_t max_leaves = 1024; // Leaves stop collecting statistics once there are this many, which bounds memory
+  size_t max_depth = std::numeric_limits<size_t>::max();
+};
+
+// Cost-complexity pruning sequence. Pruning with any alpha in [alphas[i], alphas[i + 1]) leaves
+// leaves[i] leaves whose impurities, weighted by their share of the training weight, sum to impurities[i].
+struct PRUNING_PATH {
+  std::vector<double> alphas;
+  std::vector<double> impurities;
+  std::vector<size_t> leaves;
+
+  bool empty() const { return alphas.empty(); }
+};
+
+// Counters filled while a TREE is trained with TRAIN_PROFILE. Times are wall-clock nanoseconds.
+struct TRAIN_STATS {
+  uint64_t split_search_ns = 0; // find_best_split, including candidate scoring
+  uint64_t partition_ns = 0; // Routing node rows to the children
+  uint64_t impurity_ns = 0; // Class counts and impurity of every node
+  size_t nodes = 0;
+  size_t candidates = 0; // Questions scored during split search
+  size_t rows_copied = 0; // Row indices moved while partitioning nodes in place
+  size_t peak_node_bytes = 0; // Largest heap footprint of one node's split search or partition, from buffer capacities
+};
+
+// Inference counters of a TREE predicting with PREDICT_PROFILE, merged over every thread
+struct PREDICT_STATS {
+  uint64_t predictions = 0;
+  uint64_t depth_sum = 0;
+  std::vector<uint64_t> depth_histogram; // Predictions by depth of the leaf reached
+  std::vector<uint64_t> latency_histogram; // Bucket i counts predictions taking [2^(i-1), 2^i) ns
+  std::vector<uint64_t> node_visits; // Indexed by DECISION_NODE::id(), leaves included
+
+  double mean_depth() const { return predictions ? (double) depth_sum / predictions : 0.0; }
+  uint64_t latency_percentile(double q) const; // Upper bound in ns of the bucket holding quantile q
+};
+
+// One SLOT per thread using an owner, such as the reader epochs of a MODEL_HANDLE. A thread finds its slot
+// through a thread_local cache of the last few owners it used, so moving between them never takes the lock;
+// only a thread's first use of an owner, or its first after the cache evicted it, does. When a thread exits,
+// its slot is removed from every owner still alive, after merging it into the owner's exited slot when SLOT
+// has a merge(), so counters keep what exited threads recorded.
+template<typename SLOT>
+class THREAD_SLOTS {
+  private:
+    struct TABLE {
+      std::mutex mutex;
+      std::unordered_map<std::thread::id, std::unique_ptr<SLOT>> slots;
+      std::unique_ptr<SLOT> exited; // Slots of exited threads, merged into the first one
+    };
+
+    // Owners a thread used last, and the tables it leaves when it exits
+    struct THREAD_CACHE {
+      static constexpr size_t size = 8;
+
+      std::array<uint64_t, size> ids{}; // 0 for an empty entry
+      std::array<SLOT*, size> slots{};
+      size_t next = 0; // Entry the next miss replaces
+      std::vector<std::weak_ptr<TABLE>> tables;
+
+      ~THREAD_CACHE();
+    };
+
+    std::shared_ptr<TABLE> _table; // Shared with exiting threads, which may outlive the owner briefly
+    uint64_t _id; // Never reused, so cached entries of a dead owner never match a live one
+
+    static THREAD_CACHE& _cache();
+
+  public:
+    THREAD_SLOTS();
+    THREAD_SLOTS(const THREAD_SLOTS&) = delete;
+    THREAD_SLOTS& operator=(const THREAD_SLOTS&) = delete;
+
+    template<typename... ARGS>
+    SLOT& local(ARGS&&... args); // The calling thread's slot, made from args on its first use
+    template<typename VISIT>
+    void visit(VISIT&& visit) const; // Calls visit on every slot, exited included, under the lock
+    size_t size() const; // Live threads holding a slot
+};
+
+// Counters of one predicting thread. Only the owning thread writes them, so an update is a relaxed
+// load and store rather than a locked read-modify-write; snapshots may read them at any time.
+// Once the thread exits they are merged, under the registry's lock, into those of earlier exited threads.
+struct PREDICT_COUNTERS {
+  static constexpr size_t buckets = 64;
+
+  std::atomic<uint64_t> predictions{0};
+  std::atomic<uint64_t> depth_sum{0};
+  std::array<std::atomic<uint64_t>, buckets> depth_histogram{};
+  std::array<std::atomic<uint64_t>, buckets> latency_histogram{};
+  std::vector<std::atomic<uint64_t>> node_visits;
+
+  PREDICT_COUNTERS(size_t node_ids) : node_visits(node_ids) {}
+
+  static void bump(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+  }
+  void record_depth(size_t depth);
+  void record_latency(uint64_t latency_ns);
+  void merge(const PREDICT_COUNTERS& other);
+};
+
+// Hands every thread its own PREDICT_COUNTERS through THREAD_SLOTS, so a thread predicting with a few
+// trees in turn never takes the lock, and an exited thread leaves only its merged counts behind.
+class PREDICT_REGISTRY {
+  private:
+    THREAD_SLOTS<PREDICT_COUNTERS> _counters;
+    size_t _node_ids;
+
+  public:
+    PREDICT_REGISTRY(size_t node_ids);
+
+    PREDICT_COUNTERS& local();
+    PREDICT_STATS snapshot() const;
+};
+
+// Instrumentation policies for TREE. Hooks are guarded by if constexpr on these flags,
+// so NO_PROFILE compiles them away entirely.
+struct NO_PROFILE {
+  static constexpr bool train = false;
+  static constexpr bool predict = false;
+};
+struct TRAIN_PROFILE {
+  static constexpr bool train = true;
+  static constexpr bool predict = false;
+};
+struct PREDICT_PROFILE {
+  static constexpr bool train = false;
+  static constexpr bool predict = true;
+};
+struct FULL_PROFILE {
+  static constexpr bool train = true;
+  static constexpr bool predict = true;
+};
+
+// Adds the lifetime of the timer to total when ENABLED
+template<bool ENABLED>
+struct SCOPED_TIMER {
+  SCOPED_TIMER(uint64_t&) {}
+};
+template<>
+struct SCOPED_TIMER<true> {
+  uint64_t& total;
+  std::chrono::steady_clock::time_point start;
+
+  SCOPED_TIMER(uint64_t& t) : total{t}, start{std::chrono::steady_clock::now()} {}
+  ~SCOPED_TIMER() {
+    total += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+};
+
+// Class weights of a set of rows, dense by class id; the STATS of the classification criteria.
+// Like the regression STATS below, it grows a row at a time, but only its classes() is nonzero.
+struct CLASS_STATS {
+  std::vector<double> counts;
+  double weight = 0.0;
+
+  explicit CLASS_STATS(size_t classes = 0) : counts(classes, 0.0) {}
+  void add(size_t label, double row_weight) { counts[label] += row_weight; weight += row_weight; }
+  void add(const CLASS_STATS& other);
+  void subtract(const CLASS_STATS& other);
+  size_t classes() const { return counts.size(); }
+};
+
+// Weighted sum and sum of squares of regression targets
+struct MOMENT_STATS {
+  double sum = 0.0;
+  double squares = 0.0;
+  double weight = 0.0;
+
+  explicit MOMENT_STATS(size_t = 0) {}
+  void add(double target, double row_weight);
+  void add(const MOMENT_STATS& other);
+  void subtract(const MOMENT_STATS& other);
+  size_t classes() const { return 0; }
+};
+
+// Regression targets kept in two heaps around their weighted median: low holds the median and everything
+// below it, high the rest. Adding a row costs O(log n) and the absolute deviation stays exact.
+struct MEDIAN_STATS {
+  std::vector<std::pair<double, double>> low, high; // (target, weight); a max-heap and a min-heap
+  double low_sum = 0.0, low_weight = 0.0; // Weighted sums of the targets in each heap
+  double high_sum = 0.0, high_weight = 0.0;
+  double weight = 0.0;
+
+  explicit MEDIAN_STATS(size_t = 0) {}
+  void add(double target, double row_weight);
+  void add(const MEDIAN_STATS& other);
+  size_t classes() const { return 0; }
+
+  double median() const;
+  double deviation() const; // Weighted sum of absolute differences to the median
+};
+
+// Split criteria, chosen by template parameter so split search compiles into one loop per criterion.
+// A criterion scores the STATS of a set of rows by its impurity. Subtractive criteria score a split from
+// the node and its true side, deriving the false side; the others are swept a second time from the end.
+// Any type meeting SPLIT_CRITERION below can be given to TREE.
+struct GINI {
+  using TARGET = size_t; // Class id
+  using STATS = CLASS_STATS;
+  static constexpr bool classification = true;
+  static constexpr bool subtractive = true;
+
+  static double impurity(const STATS& stats);
+  static double gain(const STATS& total, const STATS& true_side, double root_impurity);
+};
+
+// Shannon entropy in bits; its gain is the information gain
+struct ENTROPY {
+  using TARGET = size_t;
+  using STATS = CLASS_STATS;
+  static constexpr bool classification = true;
+  static constexpr bool subtractive = true;
+
+  static double impurity(const STATS& stats);
+  static double gain(const STATS& total, const STATS& true_side, double root_impurity);
+};
+
+// Mean log loss of predicting each node's class probabilities: entropy in nats. It ranks splits like
+// ENTROPY, but its gains, and so min_impurity_decrease and pruning alphas, are ln 2 times smaller.
+struct LOG_LOSS : ENTROPY {
+  static double impurity(const STATS& stats) { return ENTROPY::impurity(stats) * std::numbers::ln2; }
+  static double gain(const STATS& total, const STATS& true_side, double root_impurity);
+};
+
+// Variance reduction; leaves predict the mean target
+struct MSE {
+  using TARGET = double;
+  using STATS = MOMENT_STATS;
+  static constexpr bool classification = false;
+  static constexpr bool subtractive = true;
+
+  static double impurity(const STATS& stats); // Weighted variance
+  static double gain(const STATS& total, const STATS& true_side, double root_impurity);
+  static double value(const STATS& stats) { return stats.weight > 0 ? stats.sum / stats.weight : 0.0; }
+};
+
+// Mean absolute deviation from the median; leaves predict the median target
+struct MAE {
+  using TARGET = double;
+  using STATS = MEDIAN_STATS;
+  static constexpr bool classification = false;
+  static constexpr bool subtractive = false;
+
+  static double impurity(const STATS& stats) { return stats.weight > 0 ? stats.deviation() / stats.weight : 0.0; }
+  static double value(const STATS& stats) { return stats.median(); }
+};
+
+// Interface of a split criterion. STATS starts empty from a class count and grows by one weighted row or by
+// another STATS. Subtractive criteria also subtract STATS and score a split from the node and its true side;
+// classification criteria keep their class weights in STATS::counts, and regression ones give leaf values.
+template<typename C>
+concept SPLIT_CRITERION = requires(typename C::STATS stats, const typename C::STATS& other, typename C::TARGET target) {
+  typename C::STATS;
+  typename C::TARGET;
+  { C::classification } -> std::convertible_to<bool>;
+  { C::subtractive } -> std::convertible_to<bool>;
+  requires std::constructible_from<typename C::STATS, size_t>;
+  stats.add(target, 1.0);
+  stats.add(other);
+  { other.weight } -> std::convertible_to<double>;
+  { other.classes() } -> std::convertible_to<size_t>;
+  { C::impurity(other) } -> std::convertible_to<double>;
+} 
+&& (!C::subtractive || requires(typename C::STATS stats, const typename C::STATS& other) {
+  stats.subtract(other);
+  { C::gain(other, other, 0.0) } -> std::convertible_to<double>;
+}) 
+&& (C::classification 
+  ? requires(const typename C::STATS& other) { { other.counts[0] } -> std::convertible_to<double>; } && std::same_as<typename C::TARGET, size_t>
+  : requires(const typename C::STATS& other) { { C::value(other) } -> std::convertible_to<double>; } && std::same_as<typename C::TARGET, double>);
 
 // FORWARD DECLERATION
 //
+template<typename T, typename PROFILE = NO_PROFILE, typename CRITERION = GINI> class TREE;
+template<typename T, typename CRITERION = GINI> class HOEFFDING_TREE;
+
 template<typename T>
 class DATA : public std::vector<T> {
   public:
@@ -71,167 +452,770 @@ struct TDATA_COL : public std::vector<TDATA<T>> {
   }
 };
 
+// One row of a sparse matrix: the columns holding a value, in increasing order, and their values.
+// Columns left out read as zero, so a row costs its nonzero entries whatever the column count.
+template<typename V>
+struct SPARSE_ROW {
+  std::span<const uint32_t> indices;
+  std::span<const V> values;
+
+  V operator[](size_t column) const; // Binary search over indices
+};
+
+// Compressed sparse rows, used for prediction. Row r holds the entries [offsets[r], offsets[r + 1]).
+template<typename V>
+struct CSR_MATRIX {
+  size_t columns = 0;
+  std::vector<size_t> offsets{0};
+  std::vector<uint32_t> indices;
+  std::vector<V> values;
+
+  void push_back(std::span<const V> dense_row); // Appends a row, keeping its nonzero values only
+  SPARSE_ROW<V> row(size_t r) const;
+  size_t size() const { return offsets.size() - 1; }
+};
+
+// Compressed sparse columns, used for training. Column c holds the entries [offsets[c], offsets[c + 1]),
+// whose indices are rows in increasing order.
+template<typename V>
+struct CSC_MATRIX {
+  size_t rows = 0;
+  std::vector<size_t> offsets{0};
+  std::vector<uint32_t> indices;
+  std::vector<V> values;
+
+  void push_back(std::span<const V> dense_column); // Appends a column, keeping its nonzero values only
+  size_t col_size() const { return offsets.size() - 1; }
+};
+
+constexpr size_t NO_BUNDLE = std::numeric_limits<size_t>::max();
+constexpr size_t NO_COLUMN = std::numeric_limits<size_t>::max();
+
+// Arithmetic columns of one type that are never nonzero on the same row, packed into one column of codes.
+// Code 0 means every column is zero. Column i owns the codes [offsets[i], offsets[i + 1]), one per distinct
+// nonzero value in increasing order, so sorting codes sorts every column's values at once.
+struct FEATURE_BUNDLE {
+  std::vector<size_t> columns;
+  std::vector<uint32_t> offsets; // columns.size() + 1 entries
+  std::vector<size_t> code_rows; // A row holding the value of every code, to read it from its typed column
+  std::vector<uint32_t> codes; // Code of every row
+};
+
+// Rows of the node being split, marked over the whole dataset so the entries of a sparse column can be
+// filtered without visiting its zero rows. Marking a node writes its rows only and never clears the others.
+struct NODE_ROWS {
+  std::vector<size_t> marks; // stamp for rows of the node; stamp + 1 for rows a sparse partition sends unlike zero
+  size_t stamp = 0;
+
+  void mark(std::span<const size_t> rows, size_t dataset_size);
+  bool contains(size_t row) const { return marks[row] == stamp; }
+};
+
+// Column-major copy of training rows. Every column keeps its own element type and labels are encoded
+// to class ids, so split search runs on typed vectors and never touches a TDATA or a label string.
+template<typename T>
+struct DATASET {
+  using COLUMN_TYPE = typename COLUMN_STORAGE<T>::type;
+
+  SCHEMA schema;
+  std::vector<COLUMN_TYPE> columns;
+  std::vector<std::shared_ptr<const DICTIONARY>> dictionaries; // Set for STRING columns only
+  std::vector<size_t> labels; // Class id of every row
+  std::vector<double> targets; // Target of every row for regression, when labels and classes are empty
+  std::vector<double> weights; // Weight of every row, 1 unless reweighted
+  std::vector<std::string> classes; // Class name of every id
+  std::vector<FEATURE_BUNDLE> bundles;
+  std::vector<size_t> bundle_of; // Bundle searching each column, NO_BUNDLE for columns searched alone
+  CSC_MATRIX<T> sparse; // Columns kept compressed; their entry in columns stays empty
+  std::vector<size_t> sparse_of; // Column of sparse holding each column, NO_COLUMN for dense ones
+
+  DATASET() {}
+  DATASET(const TDATA_COL<T>& tdatacol, SCHEMA column_types = SCHEMA()); // FEATURE schemas default to the first row
+  // Arithmetic T only; throws std::invalid_argument unless there is one label per row and every entry lies
+  // within the rows. Columns at most half nonzero and without missing values stay compressed when keep_sparse
+  // is set, so training costs their entries rather than their rows; the others are scattered into dense storage.
+  // Only subtractive criteria search compressed columns. String labels are classes, double labels regression targets.
+  template<typename LABELS>
+  DATASET(const CSC_MATRIX<T>& matrix, const LABELS& row_labels, bool keep_sparse = true);
+
+  // Replaces the class labels with regression targets, one per row
+  void set_targets(std::span<const double> row_targets);
+  // Frees every row once training is done, keeping the schema, dictionaries and classes that encoding reads
+  void drop_rows();
+
+  // Encodes the strings of a row once, so walking a tree compares ids instead of strings
+  DATA<typename ENCODING<T>::type> encode(const DATA<T>& data) const;
+
+  // Multiplies every row weight by its sample weight, when given, and by the weight of its class.
+  // Classes missing from class_weights keep their weight.
+  void reweigh(std::span<const double> sample_weights, const std::unordered_map<std::string, double>& class_weights = {});
+
+  // Exclusive feature bundling: greedily packs sparse arithmetic columns whose nonzero rows never meet.
+  // Columns keep their storage for partitioning; split search reads the bundles instead.
+  void bundle_features();
+  // Appends a bundle of columns sharing an arithmetic type whose nonzero rows never meet
+  void add_bundle(std::span<const size_t> bundle_columns);
+  bool bundled(size_t column) const { return !bundle_of.empty() && bundle_of[column] != NO_BUNDLE; }
+  bool is_sparse(size_t column) const { return !sparse_of.empty() && sparse_of[column] != NO_COLUMN; }
+
+  // Nonzero entries of a compressed column among the rows node_rows marks, as (value, row). The column is
+  // scanned, or its indices binary-searched once per row when the node is small enough for that to touch fewer.
+  void sparse_entries(size_t column, std::span<const size_t> rows, const NODE_ROWS& node_rows, 
+      std::vector<std::pair<T, size_t>>& entries) const;
+
+  size_t size() const { return weights.size(); }
+  size_t col_size() const { return columns.size(); }
+  std::vector<double> count(std::span<const size_t> rows) const; // Class weights, dense by class id
+
+  // What CRITERION learns from every row: class ids or regression targets
+  template<typename CRITERION>
+  const std::vector<typename CRITERION::TARGET>& row_targets() const;
+  template<typename CRITERION>
+  typename CRITERION::STATS stats(std::span<const size_t> rows) const;
+  CLASS_COUNT class_count(std::span<const size_t> rows) const; // Rows by class name
+};
+
 template<typename T>
 class QUESTION {
   protected:
     int _column;
     T _value;
+    bool _missing_true; // Direction of missing (NaN) features, learned by split search
+    CATEGORY_SET _categories;
+    std::vector<uint32_t> _branches; // Child of every category id on k-ary questions; the last entry takes all larger ids
+    std::shared_ptr<const DICTIONARY> _dictionary;
+
+    template<typename V>
+    CATEGORY_ID _category_of(const V& feature) const;
 
   public:
     QUESTION();
-    QUESTION(int column, T value);
+    QUESTION(int column, T value, bool missing_true = false);
+    QUESTION(int column, CATEGORY_SET categories, std::shared_ptr<const DICTIONARY> dictionary = nullptr);
+    QUESTION(int column, std::vector<uint32_t> branches, std::shared_ptr<const DICTIONARY> dictionary = nullptr);
+
+    // Arithmetic features are asked "td[column] <= value", categories "td[column] in categories"
+    // and everything else "td[column] == value". Missing features answer missing_true().
+    bool operator()(const DATA<T>& td) const;
+    bool operator()(const DATA<T>& td, enum COND M) const;
+
+    // Rows already passed through DATASET::encode are answered without touching the dictionary
+    template<typename V>
+    bool answer(const V& feature) const;
+
+    // k-ary questions send every category to its own child, asked through branch() instead of answer()
+    bool multiway() const { return !_branches.empty(); }
+    size_t branches() const; // Children of the node asking it
+    template<typename V>
+    size_t branch(const V& feature) const {
+      return _branches[std::min<size_t>(static_cast<size_t>(_category_of(feature)), _branches.size() - 1)];
+    }
 
-    bool operator()(const DATA<T>& td, enum COND M = EQ) const;
+    int column() const { return _column; }
+    const T& value() const { return _value; }
+    bool missing_true() const { return _missing_true; }
+    const CATEGORY_SET& categories() const { return _categories; }
+    bool ordered() const;
 
     friend std::ostream& operator<<(std::ostream& out, const QUESTION<T>& q) {
-      out << "Question(" << q._column << ", " << q._value << ')'; 
+      out << "Question(" << q._column;
+      if(q.multiway()) {
+        // Categories apart from the default child, which takes every other id
+        out << " -> {";
+        for(size_t id = 0; id + 1 < q._branches.size(); ++id) {
+          if(q._branches[id] == q._branches.back())
+            continue;
+          if(q._dictionary)
+            out << q._dictionary->names[id];
+          else
+            out << CATEGORY_ID(id);
+          out << ": " << q._branches[id] << ", ";
+        }
+        out << "others: " << q._branches.back() << "})";
+        return out;
+      }
+      if(q._categories.empty()) {
+        out << (q.ordered() ? " <= " : " == ") << q._value << (q._missing_true ? " or missing)" : ")"); 
+        return out;
+      }
+
+      out << " in {";
+      const char* separator = "";
+      for(size_t id = 0; id < 64 * q._categories.bits.size(); ++id) {
+        if(!q._categories.contains(CATEGORY_ID(id)))
+          continue;
+        out << separator;
+        if(q._dictionary)
+          out << q._dictionary->names[id];
+        else
+          out << CATEGORY_ID(id);
+        separator = ", ";
+      }
+      out << "})";
       return out ;
     }
 };
 
 
-template<typename T> struct NODE_DATA {
-  double impurity;
-  std::shared_ptr<TDATA_COL<T>> tdatacol_sptr;
-  std::shared_ptr<CLASS_COUNT> count_sptr;
-  std::shared_ptr<PRES_CONFIDENCE> confidence_sptr;
+constexpr size_t NO_NODE = std::numeric_limits<size_t>::max();
 
-  NODE_DATA(
-      double gini = 0.0,
-      std::shared_ptr<TDATA_COL<T>> tdc_sptr = nullptr,
-      std::shared_ptr<CLASS_COUNT> cnt_sptr = nullptr,
-      std::shared_ptr<PRES_CONFIDENCE> cnf_sptr = nullptr
-      );
-  NODE_DATA(const NODE_DATA &nodedata);
-  NODE_DATA(NODE_DATA &&nodedata);
-  void operator=(const NODE_DATA& nodedata); 
-  void operator=(NODE_DATA &&nodedata); 
+// One column on the path from the root to a node during TreeSHAP. The weights of a path hold, for every
+// number of its columns, the share of column orderings that reach the node with that many of them known.
+struct SHAP_PATH_ELEMENT {
+  size_t column;
+  double zero_fraction; // Share of the training weight going the same way at the column's nodes
+  double one_fraction; // 1 when the explained row goes that way, 0 otherwise
+  double weight;
+};
 
-  bool empty() const {
-    return !tdatacol_sptr && !count_sptr && !confidence_sptr;
-  }
+// One node of a TREE. Branches and rows are positions inside the NODE_ARENA holding the node.
+template<typename T>
+struct NODE {
+  QUESTION<T> question;
+  size_t true_branch = NO_NODE; // NO_NODE on leaves
+  size_t false_branch = NO_NODE;
+  size_t branches = 0; // Children, adjacent from true_branch on; k-ary nodes have more than two
+  size_t rows_begin = 0; // Training rows reaching the node are NODE_ARENA::rows[rows_begin, rows_end)
+  size_t rows_end = 0;
+  double impurity = 0.0;
+  double weight = 0.0; // Total weight of the training rows reaching the node
+  double prune_alpha = std::numeric_limits<double>::infinity(); // Smallest alpha at which cost-complexity pruning turns this node into a leaf
+  double gain = 0.0; // Impurity decrease of the split, weighted by the node's share of the training weight
+  size_t label = 0; // Majority class id, ties going to the smaller id
+  double value = 0.0; // Mean or median target of regression trees
 
-  friend std::ostream& operator<<(std::ostream& out, const NODE_DATA& nodedata) {
-    out << "NODE_DATA(" << nodedata.impurity << ", ";
+  bool is_leaf() const { return true_branch == NO_NODE; }
+};
 
-    if(nodedata.tdatacol_sptr)
-      out << *nodedata.tdatacol_sptr;
-    else
-      out << "nullptr";
+// Every node of one TREE. Nodes, their class counts and their training rows each live in a single buffer
+// that only grows during training, so freeing a tree is a handful of deallocations whatever its size.
+template<typename T>
+struct NODE_ARENA {
+  std::vector<NODE<T>> nodes; // Creation order, root first; the index of a node is its id
+  std::vector<double> counts; // classes.size() class weights per node
+  std::vector<float> probabilities; // Counts divided by the node's weight, laid out like counts
+  std::vector<size_t> rows; // Rows of positive weight, partitioned in place so every node owns a contiguous range
+  std::vector<std::string> classes;
+  TDATA_COL<T> training_data; // Only with TREE_OPTIONS::keep_training_data
 
-    out << ", ";
+  size_t add_nodes(size_t amount); // Returns the index of the first new node
+  std::span<const double> counts_of(size_t node) const;
+  std::span<const float> probabilities_of(size_t node) const;
+  std::span<const size_t> rows_of(size_t node) const;
+};
 
-    if(nodedata.count_sptr)
-      out << nodedata.count_sptr;
-    else
-      out << "nullptr";
+// Statistics of one node, read from the arena of the TREE it came from
+template<typename T> struct NODE_DATA {
+  double impurity;
+  double weight;
+  double value; // Predicted target of regression trees
+  double prune_alpha; // Smallest alpha at which cost-complexity pruning turns this node into a leaf
+  std::span<const double> counts; // Class weights, dense by class id; row counts when every row weighs 1
+  std::span<const float> probabilities; // Dense by class id, summing to one
+  std::span<const size_t> rows; // Indices into the training data
+  const NODE_ARENA<T>* arena;
 
-    out << ", ";
+  NODE_DATA() : impurity{0.0}, weight{0.0}, value{0.0}, prune_alpha{std::numeric_limits<double>::infinity()}, arena{nullptr} {}
+  NODE_DATA(const NODE_ARENA<T>& node_arena, size_t node);
 
-    if(nodedata.confidence_sptr)
-      out << nodedata.confidence_sptr;
-    else
-      out << "nullptr";
+  bool empty() const { return !arena; }
+  size_t samples() const { return rows.size(); }
+
+  CLASS_COUNT count() const; // Class weights rounded to whole rows
+  PRES_CONFIDENCE confidence() const;
+  TDATA_COL<T> tdatacol() const; // Copies the training rows reaching the node, if TREE_OPTIONS::keep_training_data
+  TDATA_COL<T> tdatacol(const TDATA_COL<T>& training_data) const; // Same rows, read from the data the tree was trained on
+
+  friend std::ostream& operator<<(std::ostream& out, const NODE_DATA& nodedata) {
+    out << "NODE_DATA(" << nodedata.impurity << ", " << nodedata.samples() << ", {";
+
+    const char* separator = "";
+    for(size_t class_id = 0; class_id < nodedata.counts.size(); ++class_id) {
+      if(nodedata.counts[class_id] == 0)
+        continue;
+      out << separator << nodedata.arena->classes[class_id] << ": " << nodedata.counts[class_id];
+      separator = ", ";
+    }
 
-    out << ")";
+    out << "})";
     return out;
   }
 };
 
+// Handle on one node of a TREE. Copying it copies two words; it stays valid while the tree does.
 template<typename T>
 class DECISION_NODE {
+  template<typename, typename, typename> friend class TREE;
+
   private: 
-    std::shared_ptr<NODE_DATA<T>> _nodedata_sptr;
-    std::shared_ptr<QUESTION<T>> _question_sptr;
-    std::shared_ptr<DECISION_NODE> _true_branch_sptr;
-    std::shared_ptr<DECISION_NODE> _false_branch_sptr;
+    const NODE_ARENA<T>* _arena;
+    size_t _index;
+
+    const NODE<T>& _node() const { return _arena->nodes[_index]; }
 
   public:
-    DECISION_NODE(
-        std::shared_ptr<NODE_DATA<T>> nodedata_sptr = nullptr,
-        std::shared_ptr<QUESTION<T>> question_sptr = nullptr,
-        std::shared_ptr<DECISION_NODE> true_branch_sptr = nullptr,
-        std::shared_ptr<DECISION_NODE> false_branch_sptr = nullptr
-        );
+    DECISION_NODE(const NODE_ARENA<T>* arena = nullptr, size_t index = 0) : _arena{arena}, _index{index} {}
+
+    size_t id() const { return _index; } // Creation order within its TREE; kept by pruning
 
     NODE_DATA<T> nodedata() const;
-    QUESTION<T> question() const;
+    const QUESTION<T>& question() const;
     DECISION_NODE true_branch() const;
     DECISION_NODE false_branch() const;
+    size_t branches() const; // 0 on leaves
+    DECISION_NODE branch(size_t index) const; // Binary nodes have their true branch first
     bool is_leaf() const;
-    bool empty() {
-      return (!_nodedata_sptr) && (!_question_sptr) && (!_true_branch_sptr) && (!_false_branch_sptr);
+    bool empty() const {
+      return !_arena;
     }
 
     friend std::ostream& operator<<(std::ostream& out, const DECISION_NODE& dnode) {
-      out << "DECISION_NODE(" << *dnode._nodedata_sptr << ", ";
-
-      if(dnode._question_sptr == nullptr)
-        out << "nullptr";
-      else
-        out << *dnode._question_sptr;
-      out << ", ";
-
-      if(dnode._true_branch_sptr == nullptr)
-        out << "nullptr";
-      else
-        out << *dnode._true_branch_sptr;
-      out << ", ";
+      out << "DECISION_NODE(" << dnode.nodedata() << ", ";
 
-      if(dnode._false_branch_sptr == nullptr)
-        out << "nullptr";
+      if(dnode.is_leaf())
+        out << "nullptr, nullptr, nullptr";
       else
-        out << *dnode._false_branch_sptr;
+        out << dnode.question();
+      for(size_t index = 0; index < dnode.branches(); ++index)
+        out << ", " << dnode.branch(index);
 
       out << ")";
       return out;
-
     }
 };
 
-template<typename T>
+template<typename T, typename PROFILE, typename CRITERION>
 class TREE {
+  static_assert(SPLIT_CRITERION<CRITERION>, "TREE needs a CRITERION meeting SPLIT_CRITERION");
+  template<typename, typename> friend class HOEFFDING_TREE;
+
   private:
-    TDATA_COL<T> _training_data;
-    std::shared_ptr<DECISION_NODE<T>> _dtree;
+    DATASET<T> _dataset; // Rows are dropped after training, leaving the schema, dictionaries and classes
+    TREE_OPTIONS _options;
+    size_t _node_count;
+    std::shared_ptr<NODE_ARENA<T>> _arena; // Shared by copies of this tree until one of them prunes
+    PRUNING_PATH _pruning_path; // Computed once the tree is grown, kept valid across prune()
+    TRAIN_STATS _train_stats;
+    std::shared_ptr<PREDICT_REGISTRY> _predict_registry; // Shared by copies of this tree
+    std::vector<double> _gain_importances; // By column, summed as splits are made
+    std::vector<size_t> _split_counts;
+
+    // Piece of a subtree's cost function risk + alpha * leaves, valid from alpha up to the next piece
+    struct PRUNE_SEGMENT {
+      double alpha;
+      double risk;
+      size_t leaves;
+    };
 
-    std::shared_ptr<DECISION_NODE<T>> _build_tree(TDATA_COL<T>& tdatacol);
-    DECISION_NODE<T> _find_best_answer(const DATA<T>& data, const DECISION_NODE<T>& node) const;
+    // Working memory of one fit, reused by every node
+    struct BUILD_STATE {
+      std::vector<size_t> scratch; // Rows waiting during a partition
+      std::vector<std::vector<size_t>> sorted; // With presort, the rows of each arithmetic column in value order
+      std::vector<std::span<const size_t>> sorted_rows; // Range of the current node in every sorted column
+      NODE_ROWS node_rows; // Rows of the current node, marked when the dataset has compressed columns
+      std::vector<uint32_t> sides; // Child of the current split each row went to
+      std::vector<size_t> branch_sizes; // Rows of every child of the current split
+      std::mt19937_64 engine; // Seeded by TREE_OPTIONS::seed
+      std::vector<size_t> tree_columns; // Columns drawn for the tree, when subsampling
+      std::vector<std::vector<size_t>> level_columns; // Columns drawn for every depth reached so far
+      std::vector<size_t> node_columns; // Columns searched at the current node
+      typename CRITERION::STATS empty_stats, node_stats; // Copying the first over the second reuses its memory
+    };
+
+    void _fit(std::span<const double> sample_weights);
+    TREE(DATASET<T> dataset, std::shared_ptr<NODE_ARENA<T>> arena); // Adopts nodes grown elsewhere
+    void _build_tree(size_t node, BUILD_STATE& state, size_t depth = 0);
+    void _compute_pruning_path(); // Fills _pruning_path and every prune_alpha; needs the arena to itself
+    std::vector<PRUNE_SEGMENT> _cost_complexity(size_t node, double total_weight);
+    size_t _prune(size_t node, double alpha);
+    void _count_splits(size_t node); // Adds the splits of the subtree to the importances
+    double _leaf_output(size_t node, size_t output) const;
+    size_t _shap_depth(size_t node) const; // Edges on the longest path below node
+    void _shap_expected(size_t node, std::span<double> expected) const; // Adds weighted leaf outputs
+    template<typename ROW>
+    void _shap(const ROW& row, std::span<double> contributions, std::vector<SHAP_PATH_ELEMENT>& path) const;
+    template<typename ROW>
+    void _shap_recurse(const ROW& row, size_t node, std::span<double> contributions, SHAP_PATH_ELEMENT* parent_path, 
+        size_t depth, double zero_fraction, double one_fraction, size_t column) const;
+    template<typename ROW>
+    size_t _find_best_answer(const ROW& row, PREDICT_COUNTERS* counters = nullptr) const;
+    template<typename ROW>
+    DECISION_NODE<T> _predict(const ROW& row) const;
 
   public:
-    TREE(TDATA_COL<T>& training_data);
+    // Class names for classification criteria, targets for regression ones
+    using LABEL = std::conditional_t<CRITERION::classification, std::string, double>;
+
+    // Rows weigh their sample weight, when given, times the weight of their class. Rows weighing 0 are left out.
+    TREE(TDATA_COL<T>& training_data, TREE_OPTIONS options = TREE_OPTIONS(), std::span<const double> sample_weights = {});
+    // Regression on the features of training_data, whose labels are ignored, with one target per row.
+    // Any other number of targets throws std::invalid_argument.
+    TREE(TDATA_COL<T>& training_data, std::span<const double> targets, TREE_OPTIONS options = TREE_OPTIONS(), 
+        std::span<const double> sample_weights = {});
+    // Trains on sparse columns with one label per row, throwing std::invalid_argument otherwise. The tree keeps no
+    // TDATA_COL, so NODE_DATA::tdatacol() is empty.
+    // Subtractive criteria train on the compressed columns; the others need them scattered into dense storage.
+    TREE(const CSC_MATRIX<T>& training_data, std::span<const LABEL> labels, TREE_OPTIONS options = TREE_OPTIONS(), 
+        std::span<const double> sample_weights = {});
 
-    TREE() : _dtree{nullptr} {}
+    TREE() : _node_count{0} {}
     DECISION_NODE<T> predict(DATA<T> data) const;
 
+    // Reads the row where it lies: no copy, no heap allocation, and without PREDICT_PROFILE no atomics.
+    // String features are looked up in the training dictionaries as they are asked, so rows may hold
+    // either raw values or the ids DATASET::encode gives them.
+    template<typename V, size_t EXTENT>
+    DECISION_NODE<T> predict(std::span<const V, EXTENT> row) const;
+    template<typename V, size_t EXTENT>
+    size_t predict_class(std::span<const V, EXTENT> row) const; // Index into classes()
+    // Copies the leaf's class probabilities, dense by class id, into the first classes().size() floats
+    template<typename V, size_t EXTENT>
+    void predict_proba(std::span<const V, EXTENT> row, std::span<float> probabilities) const;
+    template<typename V, size_t EXTENT>
+    double predict_value(std::span<const V, EXTENT> row) const; // Leaf target of regression trees
+
+    // One prediction per row of data, in blocks of rows spread over threads; 0 threads means one per hardware thread
+    void predict_class(const TDATA_COL<T>& data, std::span<size_t> row_classes, size_t threads = 1) const;
+    void predict_value(const TDATA_COL<T>& data, std::span<double> row_values, size_t threads = 1) const;
+
+    // Sparse rows are never densified: every question looks its column up among the row's nonzero entries
+    DECISION_NODE<T> predict(const SPARSE_ROW<T>& row) const;
+    size_t predict_class(const SPARSE_ROW<T>& row) const;
+    void predict_proba(const SPARSE_ROW<T>& row, std::span<float> probabilities) const;
+    double predict_value(const SPARSE_ROW<T>& row) const;
+    void predict_class(const CSR_MATRIX<T>& matrix, std::span<size_t> row_classes) const; // One class id per row
+
+    const std::vector<std::string>& classes() const { return _dataset.classes; }
+
+    size_t node_count() const { return _node_count; }
+
+    // Impurity decrease and number of splits of every column, both kept up to date by training and pruning.
+    // Decreases are weighted by each node's share of the training weight, so they sum to what the splits removed.
+    std::span<const double> gain_importances() const { return _gain_importances; }
+    std::span<const size_t> split_counts() const { return _split_counts; }
+
+    // Loss of accuracy, or rise of mean squared error against targets for regression, when one column of data
+    // is shuffled, averaged over repeats shuffles. Shuffles are spread over threads and read the features of
+    // the rows they swap in place, so data is never copied; equal seeds give equal results on any thread count.
+    // Regression needs one target per row of data and classification none; others throw std::invalid_argument.
+    std::vector<double> permutation_importance(const TDATA_COL<T>& data, std::span<const double> targets = {}, 
+        size_t repeats = 5, uint64_t seed = 0, size_t threads = 0) const;
+
+    // TreeSHAP (Lundberg et al.): exact Shapley values of the leaf output in O(leaves * depth^2), with missing
+    // features averaged over the children by their training weight. Contributions hold shap_outputs() doubles
+    // per column, then as many for the expected output; together they sum to the leaf the row reaches.
+    // Outputs are the class probabilities of classification trees and the value of regression ones.
+    size_t shap_outputs() const { return CRITERION::classification ? classes().size() : 1; }
+    template<typename V, size_t EXTENT>
+    void shap_values(std::span<const V, EXTENT> row, std::span<double> contributions) const;
+    // Every row of data one after another, in blocks spread over threads that share one traversal plan
+    void shap_values(const TDATA_COL<T>& data, std::span<double> contributions, size_t threads = 1) const;
+
+    const TRAIN_STATS& train_stats() const {
+      static_assert(PROFILE::train, "train_stats() needs a TREE trained with TRAIN_PROFILE");
+      return _train_stats;
+    }
+
+    PREDICT_STATS predict_stats() const {
+      static_assert(PROFILE::predict, "predict_stats() needs a TREE using PREDICT_PROFILE");
+      return _predict_registry ? _predict_registry->snapshot() : PREDICT_STATS();
+    }
+
+    // Cost-complexity pruning. The path is computed once, when the tree is grown; pruning collapses every node
+    // whose prune_alpha is at most alpha. Pruning cannot be undone, so copy the tree to compare alphas.
+    const PRUNING_PATH& pruning_path() const { return _pruning_path; }
+    void prune(double alpha);
+    const TREE_OPTIONS& options() const { return _options; }
+
     bool empty() {
-      return _training_data.empty() && !_dtree;
+      return !_arena;
     }
 
     DECISION_NODE<T> dump_tree() const {
-      if(_dtree) 
-        return *_dtree;
-      else
-        return DECISION_NODE<T>();
+      return DECISION_NODE<T>(_arena.get());
     }
 
     friend std::ostream& operator<<(std::ostream& out, const TREE& tree) {
-      out << *tree._dtree;
+      out << tree.dump_tree();
       return out;
     }
 };
 
+// Epoch slot of one reading thread, on a cache line of its own so readers never write to a shared one
+struct alignas(64) READER_EPOCH {
+  static constexpr uint64_t idle = std::numeric_limits<uint64_t>::max();
+
+  std::atomic<uint64_t> epoch{idle}; // Epoch the thread's outermost read started in, idle between reads
+  size_t depth = 0; // Reads in progress on the owning thread, which alone touches it
+};
+
+// Serves a model, such as a TREE, to reading threads while a writer swaps in its retrained replacement.
+// Reads are wait-free: a read stores the current epoch in the thread's own slot, loads the model pointer and
+// clears the slot, with no lock and no shared reference count. publish() swaps the pointer and advances the
+// epoch; a retired model is freed once every slot is idle or holds a later epoch, so no read still sees it.
+template<typename MODEL>
+class MODEL_HANDLE {
+  private:
+    struct RETIRED {
+      std::unique_ptr<MODEL> model;
+      uint64_t epoch; // Reads starting at this epoch or later never see the model
+    };
+
+    std::atomic<MODEL*> _current;
+    std::atomic<uint64_t> _epoch{0};
+    mutable std::mutex _mutex; // Guards _retired
+    mutable THREAD_SLOTS<READER_EPOCH> _readers;
+    std::vector<RETIRED> _retired;
+
+    size_t _reclaim(); // Needs the lock
+
+  public:
+    explicit MODEL_HANDLE(MODEL model);
+    MODEL_HANDLE(const MODEL_HANDLE&) = delete;
+    MODEL_HANDLE& operator=(const MODEL_HANDLE&) = delete;
+    ~MODEL_HANDLE(); // No read may still be running
+
+    // Calls reader with the current model and returns its result. The model stays alive until reader
+    // returns, even if a newer one is published meanwhile. Reads may nest on one thread.
+    template<typename READER>
+    decltype(auto) read(READER&& reader) const;
+
+    // Never waits for readers: models still in use are kept and freed by a later publish() or reclaim()
+    void publish(MODEL model);
+    size_t reclaim(); // Frees every retired model no read can see, returning how many are still kept
+    uint64_t epoch() const { return _epoch.load(std::memory_order_relaxed); } // Models published so far
+    size_t readers() const { return _readers.size(); } // Live threads that have read the handle
+};
+
+// Streaming classification tree (VFDT, Domingos and Hulten). Rows are learned one at a time and never stored:
+// every leaf keeps class weights per threshold bin of each arithmetic column and per category of the others,
+// and splits once the Hoeffding bound says enough rows agree on its best question. Memory stays within
+// max_leaves * columns * max_bins class weight vectors. to_tree() exports a TREE asking the same questions.
+template<typename T, typename CRITERION>
+class HOEFFDING_TREE {
+  static_assert(CRITERION::classification && std::is_same_v<typename CRITERION::STATS, CLASS_STATS>, 
+      "HOEFFDING_TREE needs a classification CRITERION on CLASS_STATS");
+
+  private:
+    // Class weights of the rows whose feature is at most key, past the previous bin. Category bins hold one id.
+    struct BIN {
+      double key;
+      CLASS_STATS stats;
+    };
+
+    struct STREAM_NODE {
+      QUESTION<T> question;
+      size_t true_branch = NO_NODE; // The false branch follows it
+      size_t depth = 0;
+      size_t leaf = NO_NODE; // Statistics of leaves still learning, in _leaves
+      CLASS_STATS stats; // Leaves only: estimated at the split, then every row reaching them
+    };
+
+    struct LEAF {
+      size_t node;
+      CLASS_STATS seen = CLASS_STATS(); // Rows reaching the leaf since it was created, which the bound counts
+      double checked = 0.0; // Weight of seen at the last split attempt
+      std::vector<std::vector<BIN>> bins{}; // By column
+    };
+
+    HOEFFDING_OPTIONS _options;
+    SCHEMA _schema; // Taken from the first row
+    std::vector<std::shared_ptr<DICTIONARY>> _dictionaries; // Set for STRING columns only
+    std::vector<std::string> _classes;
+    std::unordered_map<std::string, size_t> _class_ids;
+    std::vector<STREAM_NODE> _nodes;
+    std::vector<LEAF> _leaves;
+    size_t _leaf_count = 1;
+    DATA<typename ENCODING<T>::type> _encoded; // Reused by every update
+
+    bool _ordered(size_t column) const { return _schema[column] == FLOAT || _schema[column] == INT; }
+    template<typename V>
+    static double _key(const V& feature); // Numeric value or category id of an encoded feature, NaN when missing
+    void _grow(CLASS_STATS& stats) const { stats.counts.resize(_classes.size(), 0.0); } // Catches up with new classes
+    void _observe(LEAF& leaf, size_t column, double key, size_t class_id, double weight);
+    void _attempt_split(size_t leaf_index);
+    QUESTION<T> _question(size_t column, double key) const;
+
+  public:
+    HOEFFDING_TREE(HOEFFDING_OPTIONS options = HOEFFDING_OPTIONS());
+
+    void update(const TDATA<T>& tdata, double weight = 1.0);
+
+    size_t node_count() const { return _nodes.size(); }
+    size_t leaf_count() const { return _leaf_count; }
+    const std::vector<std::string>& classes() const { return _classes; }
+
+    // Node ids, questions and adjacent branches carry over; internal class weights are the sums of their leaves',
+    // and dictionaries are copied, so the tree keeps predicting the same while this one learns on
+    template<typename PROFILE = NO_PROFILE>
+    TREE<T, PROFILE, CRITERION> to_tree() const;
+};
+
 template<typename T>
 double gini(const TDATA_COL<T>& r);
 
+inline double gini(const CLASS_COUNT& counts, size_t total);
+inline double gini(std::span<const double> counts, double total);
+
+// Answer to a question about one feature: ordered for arithmetic values, equality for the rest.
+// FEATUREs dispatch on the alternative the question holds.
+template<typename V>
+bool ask(const V& feature, const V& value);
+inline bool ask(const FEATURE& feature, const FEATURE& value);
+
+// Missing features are NaNs of floating-point columns
+template<typename V>
+bool missing(const V& feature);
+inline bool missing(const FEATURE& feature);
+
+// Strict order of arithmetic values that puts missing ones last, so a sorted column keeps them in one tail
+template<typename V>
+bool value_less(const V& a, const V& b);
+
+// Calls f with the typed vector behind a training column
+template<typename V, typename F>
+decltype(auto) visit_column(const std::vector<V>& column, F&& f);
+template<typename F>
+decltype(auto) visit_column(const COLUMN& column, F&& f);
+
 template<typename T>
 std::pair<TDATA_COL<T>, TDATA_COL<T>> partition(const TDATA_COL<T>& r, const QUESTION<T>& q);
 
+template<typename T>
+std::pair<std::vector<size_t>, std::vector<size_t>> partition(const DATASET<T>& dataset, std::span<const size_t> rows, const QUESTION<T>& q);
+
+// Moves the rows answering q in front of the others, keeping the order on both sides, and returns how many
+// there are. The other rows wait in scratch, which callers reuse across partitions. Questions on compressed
+// columns read the node from node_rows, marked with rows, or mark a NODE_ROWS of their own when there is none.
+template<typename T>
+size_t partition(const DATASET<T>& dataset, std::span<size_t> rows, const QUESTION<T>& q, std::vector<size_t>& scratch, 
+    NODE_ROWS* node_rows = nullptr);
+
+// Moves the rows of each child of a k-ary question together, in child order and keeping their order,
+// and sets sizes to the rows of every child
+template<typename T>
+void partition(const DATASET<T>& dataset, std::span<size_t> rows, const QUESTION<T>& q, std::vector<size_t>& scratch, std::vector<size_t>& sizes);
+
 template<typename T>
 double info_gain(const TDATA_COL<T>& left, const TDATA_COL<T>& right, double base_impurity);
 
-template<typename T, enum MODE = BINARY>
-std::pair<double, QUESTION<T>> find_best_split(const TDATA_COL<T>& tdatacol);
+// Best question found on one column. Ordered columns fill value, categorical columns fill categories
+// or, for k-ary splits, branches.
+template<typename V>
+struct SPLIT_CANDIDATE {
+  double gain = 0.0;
+  V value{};
+  bool missing_true = false; // Whether missing values join the rows answering value
+  CATEGORY_SET categories;
+  std::vector<uint32_t> branches; // Lookup table of a k-ary question
+  size_t candidates = 0; // Questions scored, legal or not
+  size_t scratch_bytes = 0; // Capacity of the buffers the search held at once
+};
+
+// Gini gain of sending true_counts to one side and the rest of total_counts to the other.
+// Counts are class weights, which are row counts when every row weighs 1.
+inline double gini_gain(
+    const std::vector<double>& total_counts, 
+    const std::vector<double>& true_counts, 
+    double true_weight, 
+    double total_weight, 
+    double root_impurity
+    );
+
+// Best split of one typed column under CRITERION, whose STATS of the node's rows are total. Arithmetic values
+// are swept as thresholds, category ids are grouped into subsets and any other value is asked one against
+// the rest. Arithmetic rows given in value order (presorted) are swept without sorting them again.
+// In MULTIPLE mode, category ids are also split one child per category when the node holds few enough.
+template<typename CRITERION, enum MODE M = BINARY, typename V>
+SPLIT_CANDIDATE<V> split_kernel(
+    const std::vector<V>& values, 
+    const std::vector<typename CRITERION::TARGET>& targets, 
+    const std::vector<double>& weights, 
+    std::span<const size_t> rows, 
+    const typename CRITERION::STATS& total, 
+    double root_impurity, 
+    const TREE_OPTIONS& options,
+    bool presorted = false
+    );
+
+// Thresholds of one arithmetic column from its nonzero entries at a node of total_size rows, in value order:
+// negative values, then the zero rows as one value, whose statistics are the node's minus the entries', then
+// positive values. CRITERION must be subtractive. Returns whether best improved.
+template<typename CRITERION, typename V>
+bool zero_aware_sweep(
+    std::span<const std::pair<V, size_t>> entries, 
+    const std::vector<typename CRITERION::TARGET>& targets, 
+    const std::vector<double>& weights, 
+    size_t total_size, 
+    const typename CRITERION::STATS& total, 
+    double root_impurity, 
+    const TREE_OPTIONS& options,
+    SPLIT_CANDIDATE<V>& best
+    );
+
+// Best threshold over the columns of one bundle, returned with its column. Only nonzero rows are sorted;
+// the zero rows of a column are the node minus its nonzero rows, swept as a single value, so CRITERION
+// must be subtractive. Columns whose searchable flag is 0 are skipped, and all are searched when there are no flags.
+template<typename CRITERION, typename V>
+std::pair<size_t, SPLIT_CANDIDATE<V>> bundle_kernel(
+    const FEATURE_BUNDLE& bundle, 
+    const std::vector<const std::vector<V>*>& column_values, 
+    const std::vector<typename CRITERION::TARGET>& targets, 
+    const std::vector<double>& weights, 
+    std::span<const size_t> rows, 
+    const typename CRITERION::STATS& total, 
+    double root_impurity, 
+    const TREE_OPTIONS& options,
+    std::span<const uint8_t> searchable = {}
+    );
+
+template<typename T, enum MODE = BINARY, typename CRITERION = GINI>
+std::pair<double, QUESTION<T>> find_best_split(const TDATA_COL<T>& tdatacol, const TREE_OPTIONS& options = TREE_OPTIONS());
+
+// Path updates of TreeSHAP: adding a column, removing the one at index and the weight the path would have without it
+inline void shap_extend(SHAP_PATH_ELEMENT* path, size_t depth, double zero_fraction, double one_fraction, size_t column);
+inline void shap_unwind(SHAP_PATH_ELEMENT* path, size_t depth, size_t index);
+inline double shap_unwound_sum(const SHAP_PATH_ELEMENT* path, size_t depth, size_t index);
+
+// Shapley values of the average of trees, which are the average of theirs. Trees must share their columns and classes.
+template<typename T, typename PROFILE, typename CRITERION, typename V, size_t EXTENT>
+void shap_values(const std::vector<TREE<T, PROFILE, CRITERION>>& trees, std::span<const V, EXTENT> row, std::span<double> contributions);
+template<typename T, typename PROFILE, typename CRITERION>
+void shap_values(const std::vector<TREE<T, PROFILE, CRITERION>>& trees, const TDATA_COL<T>& data, 
+    std::span<double> contributions, size_t threads = 1);
+
+// Runs body over [0, items) in contiguous blocks, one per thread; 0 threads means one per hardware thread
+inline void parallel_for(size_t items, size_t threads, const std::function<void(size_t begin, size_t end)>& body);
+
+// Keeps amount of the items, drawn uniformly without replacement, in their original order
+inline void sample_in_place(std::vector<size_t>& items, size_t amount, std::mt19937_64& engine);
+// Number of items a fraction of them keeps: at least one when there are any
+inline size_t sample_size(size_t items, double fraction);
+
+// Times each of rows is drawn by a bootstrap sample of the same size. Training on these weights matches
+// training on the resampled rows, without copying any of them.
+inline std::vector<double> bootstrap_weights(size_t rows, uint64_t seed);
+
+// Gradient-based one-side sampling. Keeps the top_rate share of rows with the largest absolute gradient at
+// weight 1 and draws an other_rate share of the rest, weighted so their sum still stands for every small
+// gradient row. The remaining rows weigh 0, so trees trained on these weights never visit them.
+inline std::vector<double> goss_weights(std::span<const double> gradients, double top_rate, double other_rate, uint64_t seed);
+
+// Candidate counts are added to stats when given. A non-empty sorted_rows[column] holds the same rows
+// as rows, ordered by that column's values. Only the given columns are searched, all when there are none.
+// Bundles are only searched by subtractive criteria; the others search bundled columns alone. Compressed
+// columns need a subtractive criterion and node_rows marked with rows, or mark a NODE_ROWS of their own.
+// MULTIPLE mode may answer with a k-ary question on a categorical column, see TREE_OPTIONS::max_branches.
+template<typename T, enum MODE = BINARY, typename CRITERION = GINI>
+std::pair<double, QUESTION<T>> find_best_split(
+    const DATASET<T>& dataset, 
+    std::span<const size_t> rows, 
+    const TREE_OPTIONS& options = TREE_OPTIONS(), 
+    TRAIN_STATS* stats = nullptr,
+    std::span<const std::span<const size_t>> sorted_rows = {},
+    std::span<const size_t> columns = {},
+    const NODE_ROWS* node_rows = nullptr
+    );
 
 // DECELERATION END
 
@@ -239,40 +1223,753 @@ std::pair<double, QUESTION<T>> find_best_split(const TDATA_COL<T>& tdatacol);
 
 /// DEFINITIONS
 //
-// DATA Definitions
-template<typename T>
-DATA<T>::DATA(std::vector<T>& r) : std::vector<T>::vector(r) {}
-template<typename T>
-DATA<T>::DATA(std::vector<T>&& r) : std::vector<T>::vector(r) {}
+// PREDICT_STATS Definitions
+inline uint64_t PREDICT_STATS::latency_percentile(double q) const {
+  uint64_t total = 0, seen = 0;
+  for(uint64_t amount : latency_histogram)
+    total += amount;
 
-// TDATA Definitions
-template<typename T>
-TDATA<T>::TDATA(std::string data_label, std::vector<T>& r) : label{data_label}, DATA<T>(r) {}
-template<typename T>
-TDATA<T>::TDATA(std::string data_label, std::vector<T>&& r) : label{data_label}, DATA<T>(r) {}
+  for(size_t bucket = 0; bucket < latency_histogram.size(); ++bucket) {
+    seen += latency_histogram[bucket];
+    if(total && seen >= q * total)
+      return uint64_t(1) << bucket;
+  }
+  return 0;
+}
 
-// TDATA_COL Definitions
-template<typename T>
-size_t TDATA_COL<T>::col_size() const { return (*this)[0].size(); }
-template<typename T>
-CLASS_COUNT TDATA_COL<T>::count() const {
-  CLASS_COUNT data_counts{0};
+// THREAD_SLOTS Definitions
+template<typename SLOT>
+THREAD_SLOTS<SLOT>::THREAD_SLOTS() : _table{std::make_shared<TABLE>()} {
+  static std::atomic<uint64_t> next_id{1};
+  _id = next_id.fetch_add(1, std::memory_order_relaxed);
+}
 
-  for(const auto tdata : *this) {
-    const std::string& name = tdata.label;
-    data_counts[name] += 1;
+template<typename SLOT>
+THREAD_SLOTS<SLOT>::THREAD_CACHE::~THREAD_CACHE() {
+  for(const auto& weak : tables)
+    if(auto table = weak.lock()) {
+      std::lock_guard<std::mutex> lock(table->mutex);
+      auto slot = table->slots.find(std::this_thread::get_id());
+      if constexpr (requires(SLOT& into, const SLOT& from) { into.merge(from); }) {
+        if(!table->exited)
+          table->exited = std::move(slot->second);
+        else
+          table->exited->merge(*slot->second);
+      }
+      table->slots.erase(slot);
+    }
+}
+
+template<typename SLOT>
+typename THREAD_SLOTS<SLOT>::THREAD_CACHE& THREAD_SLOTS<SLOT>::_cache() {
+  // Outside local(), so every instantiation of it shares the one cache
+  static thread_local THREAD_CACHE cache;
+  return cache;
+}
+
+template<typename SLOT>
+template<typename... ARGS>
+SLOT& THREAD_SLOTS<SLOT>::local(ARGS&&... args) {
+  THREAD_CACHE& cache = _cache();
+  for(size_t entry = 0; entry < THREAD_CACHE::size; ++entry)
+    if(cache.ids[entry] == _id)
+      return *cache.slots[entry];
+
+  std::lock_guard<std::mutex> lock(_table->mutex);
+  auto& slot = _table->slots[std::this_thread::get_id()];
+  if(!slot) {
+    slot = std::make_unique<SLOT>(std::forward<ARGS>(args)...);
+    std::erase_if(cache.tables, [](const std::weak_ptr<TABLE>& table) { return table.expired(); });
+    cache.tables.push_back(_table);
   }
 
-  return data_counts;
+  size_t entry = cache.next;
+  cache.next = (entry + 1) % THREAD_CACHE::size;
+  cache.ids[entry] = _id;
+  cache.slots[entry] = slot.get();
+  return *slot;
 }
 
-// QUESTION Definitions
-template<typename T>
-QUESTION<T>::QUESTION() : _column{0}, _value{T()} {}
-template<typename T>
-QUESTION<T>::QUESTION(int column, T value) : _column{column}, _value{value} {}
-template<typename T>
-bool QUESTION<T>::operator()(const DATA<T>& td, enum COND M) const {
+template<typename SLOT>
+template<typename VISIT>
+void THREAD_SLOTS<SLOT>::visit(VISIT&& visit) const {
+  std::lock_guard<std::mutex> lock(_table->mutex);
+  for(const auto& [thread, slot] : _table->slots)
+    visit(*slot);
+  if(_table->exited)
+    visit(*_table->exited);
+}
+
+template<typename SLOT>
+size_t THREAD_SLOTS<SLOT>::size() const {
+  std::lock_guard<std::mutex> lock(_table->mutex);
+  return _table->slots.size();
+}
+
+// PREDICT_COUNTERS Definitions
+inline void PREDICT_COUNTERS::record_depth(size_t depth) {
+  bump(predictions);
+  bump(depth_sum, depth);
+  bump(depth_histogram[std::min(depth, buckets - 1)]);
+}
+inline void PREDICT_COUNTERS::record_latency(uint64_t latency_ns) {
+  bump(latency_histogram[std::min<size_t>(std::bit_width(latency_ns), buckets - 1)]);
+}
+inline void PREDICT_COUNTERS::merge(const PREDICT_COUNTERS& other) {
+  bump(predictions, other.predictions.load(std::memory_order_relaxed));
+  bump(depth_sum, other.depth_sum.load(std::memory_order_relaxed));
+  for(size_t bucket = 0; bucket < buckets; ++bucket) {
+    bump(depth_histogram[bucket], other.depth_histogram[bucket].load(std::memory_order_relaxed));
+    bump(latency_histogram[bucket], other.latency_histogram[bucket].load(std::memory_order_relaxed));
+  }
+  for(size_t id = 0; id < node_visits.size(); ++id)
+    bump(node_visits[id], other.node_visits[id].load(std::memory_order_relaxed));
+}
+
+// PREDICT_REGISTRY Definitions
+inline PREDICT_REGISTRY::PREDICT_REGISTRY(size_t node_ids) : _node_ids{node_ids} {}
+inline PREDICT_COUNTERS& PREDICT_REGISTRY::local() {
+  return _counters.local(_node_ids);
+}
+inline PREDICT_STATS PREDICT_REGISTRY::snapshot() const {
+  PREDICT_STATS stats;
+  stats.depth_histogram.assign(PREDICT_COUNTERS::buckets, 0);
+  stats.latency_histogram.assign(PREDICT_COUNTERS::buckets, 0);
+  stats.node_visits.assign(_node_ids, 0);
+
+  _counters.visit([&](const PREDICT_COUNTERS& counters) {
+    stats.predictions += counters.predictions.load(std::memory_order_relaxed);
+    stats.depth_sum += counters.depth_sum.load(std::memory_order_relaxed);
+
+    for(size_t bucket = 0; bucket < PREDICT_COUNTERS::buckets; ++bucket) {
+      stats.depth_histogram[bucket] += counters.depth_histogram[bucket].load(std::memory_order_relaxed);
+      stats.latency_histogram[bucket] += counters.latency_histogram[bucket].load(std::memory_order_relaxed);
+    }
+
+    for(size_t id = 0; id < _node_ids; ++id)
+      stats.node_visits[id] += counters.node_visits[id].load(std::memory_order_relaxed);
+  });
+
+  return stats;
+}
+
+// CLASS_STATS Definitions
+inline void CLASS_STATS::add(const CLASS_STATS& other) {
+  for(size_t class_id = 0; class_id < counts.size(); ++class_id)
+    counts[class_id] += other.counts[class_id];
+  weight += other.weight;
+}
+inline void CLASS_STATS::subtract(const CLASS_STATS& other) {
+  for(size_t class_id = 0; class_id < counts.size(); ++class_id)
+    counts[class_id] -= other.counts[class_id];
+  weight -= other.weight;
+}
+
+// MOMENT_STATS Definitions
+inline void MOMENT_STATS::add(double target, double row_weight) {
+  sum += row_weight * target;
+  squares += row_weight * target * target;
+  weight += row_weight;
+}
+inline void MOMENT_STATS::add(const MOMENT_STATS& other) {
+  sum += other.sum;
+  squares += other.squares;
+  weight += other.weight;
+}
+inline void MOMENT_STATS::subtract(const MOMENT_STATS& other) {
+  sum -= other.sum;
+  squares -= other.squares;
+  weight -= other.weight;
+}
+
+// MEDIAN_STATS Definitions
+inline void MEDIAN_STATS::add(double target, double row_weight) {
+  auto below = [](const auto& a, const auto& b) { return a.first < b.first; };
+  auto above = [](const auto& a, const auto& b) { return a.first > b.first; };
+
+  weight += row_weight;
+  if(low.empty() || target <= low.front().first) {
+    low.emplace_back(target, row_weight);
+    std::push_heap(low.begin(), low.end(), below);
+    low_sum += row_weight * target;
+    low_weight += row_weight;
+  } else {
+    high.emplace_back(target, row_weight);
+    std::push_heap(high.begin(), high.end(), above);
+    high_sum += row_weight * target;
+    high_weight += row_weight;
+  }
+
+  // The weighted median tops low: low weighs at least half of every row, and less without its top
+  while(!low.empty() && 2 * (low_weight - low.front().second) >= weight) {
+    std::pop_heap(low.begin(), low.end(), below);
+    auto [value, value_weight] = low.back();
+    low.pop_back();
+    low_sum -= value_weight * value;
+    low_weight -= value_weight;
+
+    high.emplace_back(value, value_weight);
+    std::push_heap(high.begin(), high.end(), above);
+    high_sum += value_weight * value;
+    high_weight += value_weight;
+  }
+  while(!high.empty() && 2 * low_weight < weight) {
+    std::pop_heap(high.begin(), high.end(), above);
+    auto [value, value_weight] = high.back();
+    high.pop_back();
+    high_sum -= value_weight * value;
+    high_weight -= value_weight;
+
+    low.emplace_back(value, value_weight);
+    std::push_heap(low.begin(), low.end(), below);
+    low_sum += value_weight * value;
+    low_weight += value_weight;
+  }
+}
+inline void MEDIAN_STATS::add(const MEDIAN_STATS& other) {
+  for(const auto& [value, value_weight] : other.low)
+    add(value, value_weight);
+  for(const auto& [value, value_weight] : other.high)
+    add(value, value_weight);
+}
+inline double MEDIAN_STATS::median() const {
+  return low.empty() ? 0.0 : low.front().first;
+}
+inline double MEDIAN_STATS::deviation() const {
+  double m = median();
+  return std::max(0.0, m * low_weight - low_sum + high_sum - m * high_weight);
+}
+
+// GINI Definitions
+inline double GINI::impurity(const STATS& stats) {
+  return gini(stats.counts, stats.weight);
+}
+inline double GINI::gain(const STATS& total, const STATS& true_side, double root_impurity) {
+  return gini_gain(total.counts, true_side.counts, true_side.weight, total.weight, root_impurity);
+}
+
+// ENTROPY Definitions
+inline double ENTROPY::impurity(const STATS& stats) {
+  double impurity = 0.0;
+  for(double amount : stats.counts)
+    if(amount > 0)
+      impurity -= amount / stats.weight * std::log2(amount / stats.weight);
+  return impurity;
+}
+inline double ENTROPY::gain(const STATS& total, const STATS& true_side, double root_impurity) {
+  // A side's entropy times its weight is weight * log2(weight) - sum of count * log2(count)
+  auto plogp = [](double amount) { return amount > 0 ? amount * std::log2(amount) : 0.0; };
+  double false_weight = total.weight - true_side.weight;
+  double risk = plogp(true_side.weight) + plogp(false_weight);
+
+  for(size_t class_id = 0; class_id < true_side.counts.size(); ++class_id)
+    risk -= plogp(true_side.counts[class_id]) + plogp(total.counts[class_id] - true_side.counts[class_id]);
+
+  return root_impurity - risk / total.weight;
+}
+
+// LOG_LOSS Definitions
+inline double LOG_LOSS::gain(const STATS& total, const STATS& true_side, double root_impurity) {
+  return ENTROPY::gain(total, true_side, root_impurity / std::numbers::ln2) * std::numbers::ln2;
+}
+
+// MSE Definitions
+inline double MSE::impurity(const STATS& stats) {
+  if(stats.weight <= 0)
+    return 0.0;
+  double mean = stats.sum / stats.weight;
+  return std::max(0.0, stats.squares / stats.weight - mean * mean);
+}
+inline double MSE::gain(const STATS& total, const STATS& true_side, double root_impurity) {
+  // Weighted variance times weight is squares - sum^2 / weight, so the false side needs no STATS of its own
+  double false_weight = total.weight - true_side.weight, false_sum = total.sum - true_side.sum;
+  double true_risk = true_side.squares - true_side.sum * true_side.sum / true_side.weight;
+  double false_risk = (total.squares - true_side.squares) - false_sum * false_sum / false_weight;
+  return root_impurity - (true_risk + false_risk) / total.weight;
+}
+
+// DATA Definitions
+template<typename T>
+DATA<T>::DATA(std::vector<T>& r) : std::vector<T>::vector(r) {}
+template<typename T>
+DATA<T>::DATA(std::vector<T>&& r) : std::vector<T>::vector(r) {}
+
+// TDATA Definitions
+template<typename T>
+TDATA<T>::TDATA(std::string data_label, std::vector<T>& r) : label{data_label}, DATA<T>(r) {}
+template<typename T>
+TDATA<T>::TDATA(std::string data_label, std::vector<T>&& r) : label{data_label}, DATA<T>(r) {}
+
+// TDATA_COL Definitions
+template<typename T>
+size_t TDATA_COL<T>::col_size() const { return (*this)[0].size(); }
+template<typename T>
+CLASS_COUNT TDATA_COL<T>::count() const {
+  CLASS_COUNT data_counts{0};
+
+  for(const auto tdata : *this) {
+    const std::string& name = tdata.label;
+    data_counts[name] += 1;
+  }
+
+  return data_counts;
+}
+
+// SPARSE_ROW Definitions
+template<typename V>
+V SPARSE_ROW<V>::operator[](size_t column) const {
+  auto it = std::lower_bound(indices.begin(), indices.end(), column);
+  return it != indices.end() && *it == column ? values[it - indices.begin()] : V{};
+}
+
+// CSR_MATRIX Definitions
+template<typename V>
+void CSR_MATRIX<V>::push_back(std::span<const V> dense_row) {
+  columns = std::max(columns, dense_row.size());
+  for(size_t column = 0; column < dense_row.size(); ++column) {
+    if(dense_row[column] != V{}) {
+      indices.push_back(column);
+      values.push_back(dense_row[column]);
+    }
+  }
+  offsets.push_back(indices.size());
+}
+template<typename V>
+SPARSE_ROW<V> CSR_MATRIX<V>::row(size_t r) const {
+  size_t begin = offsets[r], end = offsets[r + 1];
+  return SPARSE_ROW<V>{
+    std::span<const uint32_t>(indices.data() + begin, end - begin), 
+    std::span<const V>(values.data() + begin, end - begin)
+  };
+}
+
+// CSC_MATRIX Definitions
+template<typename V>
+void CSC_MATRIX<V>::push_back(std::span<const V> dense_column) {
+  rows = std::max(rows, dense_column.size());
+  for(size_t row = 0; row < dense_column.size(); ++row) {
+    if(dense_column[row] != V{}) {
+      indices.push_back(row);
+      values.push_back(dense_column[row]);
+    }
+  }
+  offsets.push_back(indices.size());
+}
+
+// DICTIONARY Definitions
+inline CATEGORY_ID DICTIONARY::encode(const std::string& name) {
+  auto [it, inserted] = ids.emplace(name, CATEGORY_ID(names.size()));
+  if(inserted)
+    names.push_back(name);
+  return it->second;
+}
+inline CATEGORY_ID DICTIONARY::find(const std::string& name) const {
+  auto it = ids.find(name);
+  return it == ids.end() ? UNKNOWN_CATEGORY : it->second;
+}
+
+// CATEGORY_SET Definitions
+inline void CATEGORY_SET::insert(CATEGORY_ID id) {
+  size_t i = static_cast<size_t>(id);
+  if(i / 64 >= bits.size())
+    bits.resize(i / 64 + 1, 0);
+  bits[i / 64] |= uint64_t(1) << (i % 64);
+}
+inline size_t CATEGORY_SET::size() const {
+  size_t total = 0;
+  for(uint64_t word : bits)
+    total += std::popcount(word);
+  return total;
+}
+
+// NODE_ROWS Definitions
+inline void NODE_ROWS::mark(std::span<const size_t> rows, size_t dataset_size) {
+  if(marks.size() < dataset_size)
+    marks.resize(dataset_size, 0);
+
+  // Stamps advance by two, so no row flagged with stamp + 1 is mistaken for one of the next node
+  stamp += 2;
+  for(size_t row : rows)
+    marks[row] = stamp;
+}
+
+// DATASET Definitions
+template<typename T>
+DATASET<T>::DATASET(const TDATA_COL<T>& tdatacol, SCHEMA column_types) : schema{std::move(column_types)} {
+  size_t column_size = tdatacol.empty() ? 0 : tdatacol.col_size();
+  std::unordered_map<std::string, size_t> class_ids;
+
+  labels.reserve(tdatacol.size());
+  for(const auto& tdata : tdatacol) {
+    auto [it, inserted] = class_ids.emplace(tdata.label, classes.size());
+    if(inserted)
+      classes.push_back(tdata.label);
+    labels.push_back(it->second);
+  }
+  weights.assign(labels.size(), 1.0);
+
+  if constexpr (std::is_same_v<T, FEATURE>) {
+    if(schema.empty())
+      for(size_t column_idx = 0; column_idx < column_size; ++column_idx)
+        schema.push_back(COLTYPE(tdatacol[0][column_idx].index()));
+  } else {
+    COLTYPE type = std::is_floating_point_v<T> ? FLOAT : std::is_integral_v<T> ? INT : STRING;
+    schema.assign(column_size, type);
+  }
+
+  for(size_t column_idx = 0; column_idx < column_size; ++column_idx) {
+    std::shared_ptr<DICTIONARY> dictionary;
+    if(schema[column_idx] == STRING)
+      dictionary = std::make_shared<DICTIONARY>();
+
+    // Rows that disagree with the schema throw std::bad_variant_access
+    auto load = [&](auto& values) {
+      using V = typename std::decay_t<decltype(values)>::value_type;
+      values.reserve(tdatacol.size());
+
+      for(const auto& tdata : tdatacol) {
+        const T& feature = tdata[column_idx];
+        if constexpr (std::is_same_v<T, std::string>)
+          values.push_back(dictionary->encode(feature));
+        else if constexpr (std::is_same_v<T, FEATURE> && std::is_same_v<V, CATEGORY_ID>)
+          values.push_back(dictionary ? dictionary->encode(std::get<STRING>(feature)) : std::get<CATEGORY>(feature));
+        else if constexpr (std::is_same_v<T, FEATURE>)
+          values.push_back(std::get<V>(feature));
+        else
+          values.push_back(feature);
+      }
+    };
+
+    if constexpr (std::is_same_v<T, FEATURE>) {
+      switch(schema[column_idx]) {
+        case FLOAT: columns.emplace_back(std::in_place_index<FLOAT>); break;
+        case INT: columns.emplace_back(std::in_place_index<INT>); break;
+        default: columns.emplace_back(std::in_place_index<CATEGORY>); break;
+      }
+      std::visit(load, columns.back());
+    } else {
+      columns.emplace_back();
+      load(columns.back());
+    }
+
+    dictionaries.push_back(std::move(dictionary));
+  }
+}
+template<typename T>
+template<typename LABELS>
+DATASET<T>::DATASET(const CSC_MATRIX<T>& matrix, const LABELS& row_labels, bool keep_sparse) {
+  static_assert(std::is_arithmetic_v<T>, "CSC_MATRIX training needs arithmetic features");
+  if(row_labels.size() != matrix.rows)
+    throw std::invalid_argument("DATASET: a CSC_MATRIX needs one label per row");
+  if(std::any_of(matrix.indices.begin(), matrix.indices.end(), [&](uint32_t row) { return row >= matrix.rows; }))
+    throw std::invalid_argument("DATASET: CSC_MATRIX entry past its last row");
+
+  if constexpr (std::is_same_v<typename LABELS::value_type, std::string>) {
+    std::unordered_map<std::string, size_t> class_ids;
+    labels.reserve(row_labels.size());
+    for(const std::string& label : row_labels) {
+      auto [it, inserted] = class_ids.emplace(label, classes.size());
+      if(inserted)
+        classes.push_back(label);
+      labels.push_back(it->second);
+    }
+  } else {
+    targets.assign(row_labels.begin(), row_labels.end());
+  }
+  weights.assign(row_labels.size(), 1.0);
+
+  schema.assign(matrix.col_size(), std::is_floating_point_v<T> ? FLOAT : INT);
+  dictionaries.resize(matrix.col_size());
+  columns.resize(matrix.col_size());
+  sparse_of.assign(matrix.col_size(), NO_COLUMN);
+  sparse.rows = size();
+
+  for(size_t column_idx = 0; column_idx < matrix.col_size(); ++column_idx) {
+    size_t begin = matrix.offsets[column_idx], end = matrix.offsets[column_idx + 1];
+
+    // Columns dense enough that sorting every row costs little more than sorting their entries are scattered,
+    // as are those with missing values, which need the two-sided sweep of split_kernel
+    auto entry_values = matrix.values.begin();
+    bool has_missing = std::any_of(entry_values + begin, entry_values + end, [](T value) { return missing(value); });
+    if(keep_sparse && 2 * (end - begin) <= size() && !has_missing) {
+      sparse_of[column_idx] = sparse.col_size();
+      sparse.indices.insert(sparse.indices.end(), matrix.indices.begin() + begin, matrix.indices.begin() + end);
+      sparse.values.insert(sparse.values.end(), entry_values + begin, entry_values + end);
+      sparse.offsets.push_back(sparse.indices.size());
+      continue;
+    }
+
+    std::vector<T>& values = columns[column_idx];
+    values.assign(size(), T{});
+    for(size_t e = begin; e < end; ++e)
+      values[matrix.indices[e]] = matrix.values[e];
+  }
+}
+template<typename T>
+void DATASET<T>::sparse_entries(size_t column, std::span<const size_t> rows, const NODE_ROWS& node_rows, 
+    std::vector<std::pair<T, size_t>>& entries) const {
+  size_t sparse_column = sparse_of[column];
+  size_t begin = sparse.offsets[sparse_column], end = sparse.offsets[sparse_column + 1];
+  entries.clear();
+
+  if(rows.size() * std::bit_width(end - begin) < end - begin) {
+    auto first = sparse.indices.begin() + begin, last = sparse.indices.begin() + end;
+    for(size_t row : rows) {
+      auto it = std::lower_bound(first, last, row);
+      if(it != last && *it == row)
+        entries.emplace_back(sparse.values[it - sparse.indices.begin()], row);
+    }
+    return;
+  }
+
+  for(size_t e = begin; e < end; ++e)
+    if(node_rows.contains(sparse.indices[e]))
+      entries.emplace_back(sparse.values[e], sparse.indices[e]);
+}
+template<typename T>
+DATA<typename ENCODING<T>::type> DATASET<T>::encode(const DATA<T>& data) const {
+  if constexpr (std::is_same_v<T, std::string>) {
+    DATA<CATEGORY_ID> encoded;
+    encoded.reserve(data.size());
+    for(size_t column_idx = 0; column_idx < data.size(); ++column_idx)
+      encoded.push_back(dictionaries[column_idx]->find(data[column_idx]));
+    return encoded;
+  } else if constexpr (std::is_same_v<T, FEATURE>) {
+    DATA<FEATURE> encoded(data);
+    for(size_t column_idx = 0; column_idx < data.size(); ++column_idx)
+      if(auto name = std::get_if<STRING>(&data[column_idx]); name && dictionaries[column_idx])
+        encoded[column_idx] = dictionaries[column_idx]->find(*name);
+    return encoded;
+  } else {
+    return data;
+  }
+}
+template<typename T>
+void DATASET<T>::set_targets(std::span<const double> row_targets) {
+  targets.assign(row_targets.begin(), row_targets.end());
+  labels.clear();
+  classes.clear();
+}
+template<typename T>
+void DATASET<T>::drop_rows() {
+  for(COLUMN_TYPE& column : columns)
+    column = COLUMN_TYPE();
+  labels = {};
+  targets = {};
+  weights = {};
+  bundles = {};
+  bundle_of = {};
+  sparse = CSC_MATRIX<T>();
+  sparse_of = {};
+}
+template<typename T>
+void DATASET<T>::reweigh(std::span<const double> sample_weights, const std::unordered_map<std::string, double>& class_weights) {
+  std::vector<double> class_weight(classes.size(), 1.0);
+  for(size_t class_id = 0; class_id < classes.size(); ++class_id)
+    if(auto it = class_weights.find(classes[class_id]); it != class_weights.end())
+      class_weight[class_id] = it->second;
+
+  // Regression rows have no class to weigh
+  for(size_t row = 0; row < size(); ++row)
+    weights[row] *= (row < sample_weights.size() ? sample_weights[row] : 1.0) * (labels.empty() ? 1.0 : class_weight[labels[row]]);
+}
+template<typename T>
+void DATASET<T>::bundle_features() {
+  struct SPARSE_COLUMN {
+    size_t column;
+    size_t type;
+    std::vector<size_t> rows; // Rows where the column is nonzero
+  };
+
+  std::vector<SPARSE_COLUMN> sparse;
+  for(size_t column_idx = 0; column_idx < col_size(); ++column_idx) {
+    visit_column(columns[column_idx], [&](const auto& values) {
+      using V = typename std::decay_t<decltype(values)>::value_type;
+      if constexpr (std::is_arithmetic_v<V>) {
+        // Missing values need the two-sided sweep of split_kernel
+        if(std::any_of(values.begin(), values.end(), [](V value) { return missing(value); }))
+          return;
+
+        SPARSE_COLUMN column{column_idx, std::is_floating_point_v<V> ? (size_t) FLOAT : (size_t) INT, {}};
+        for(size_t row = 0; row < values.size(); ++row)
+          if(values[row] != V{})
+            column.rows.push_back(row);
+
+        if(!column.rows.empty() && column.rows.size() < values.size())
+          sparse.push_back(std::move(column));
+      }
+    });
+  }
+
+  // Densest columns first, each joining the first bundle of its type whose rows it does not meet
+  std::stable_sort(sparse.begin(), sparse.end(), [](const SPARSE_COLUMN& a, const SPARSE_COLUMN& b) {
+    return a.rows.size() > b.rows.size();
+  });
+
+  std::vector<std::vector<const SPARSE_COLUMN*>> groups;
+  std::vector<size_t> group_types;
+  std::vector<std::vector<uint8_t>> occupied;
+
+  for(const SPARSE_COLUMN& column : sparse) {
+    size_t group = 0;
+    for(; group < groups.size(); ++group) {
+      if(group_types[group] != column.type)
+        continue;
+      if(std::none_of(column.rows.begin(), column.rows.end(), [&](size_t row) { return occupied[group][row]; }))
+        break;
+    }
+
+    if(group == groups.size()) {
+      groups.emplace_back();
+      group_types.push_back(column.type);
+      occupied.emplace_back(size(), 0);
+    }
+    groups[group].push_back(&column);
+    for(size_t row : column.rows)
+      occupied[group][row] = 1;
+  }
+
+  bundle_of.assign(col_size(), NO_BUNDLE);
+  bundles.clear();
+
+  for(const auto& group : groups) {
+    // A lone column still gains when sparse: its sweep sorts the nonzero rows only
+    if(group.size() < 2 && 2 * group.front()->rows.size() > size())
+      continue;
+
+    std::vector<size_t> bundle_columns;
+    for(const SPARSE_COLUMN* column : group)
+      bundle_columns.push_back(column->column);
+    add_bundle(bundle_columns);
+  }
+}
+template<typename T>
+void DATASET<T>::add_bundle(std::span<const size_t> bundle_columns) {
+  if(bundle_of.empty())
+    bundle_of.assign(col_size(), NO_BUNDLE);
+
+  FEATURE_BUNDLE bundle;
+  bundle.codes.assign(size(), 0);
+  bundle.code_rows.push_back(0); // Code 0 stands for zero in every column
+  bundle.offsets.push_back(1);
+
+  for(size_t column_idx : bundle_columns) {
+    visit_column(columns[column_idx], [&](const auto& values) {
+      using V = typename std::decay_t<decltype(values)>::value_type;
+      std::vector<size_t> rows;
+      for(size_t row = 0; row < values.size(); ++row)
+        if(values[row] != V{})
+          rows.push_back(row);
+      std::stable_sort(rows.begin(), rows.end(), [&](size_t a, size_t b) { return values[a] < values[b]; });
+
+      for(size_t i = 0; i < rows.size(); ++i) {
+        if(i == 0 || values[rows[i - 1]] < values[rows[i]])
+          bundle.code_rows.push_back(rows[i]);
+        bundle.codes[rows[i]] = bundle.code_rows.size() - 1;
+      }
+    });
+
+    bundle_of[column_idx] = bundles.size();
+    bundle.columns.push_back(column_idx);
+    bundle.offsets.push_back(bundle.code_rows.size());
+  }
+
+  bundles.push_back(std::move(bundle));
+}
+template<typename T>
+std::vector<double> DATASET<T>::count(std::span<const size_t> rows) const {
+  std::vector<double> counts(classes.size(), 0.0);
+  for(size_t row : rows)
+    counts[labels[row]] += weights[row];
+  return counts;
+}
+template<typename T>
+CLASS_COUNT DATASET<T>::class_count(std::span<const size_t> rows) const {
+  CLASS_COUNT data_counts{0};
+  for(size_t row : rows)
+    data_counts[classes[labels[row]]] += 1;
+  return data_counts;
+}
+template<typename T>
+template<typename CRITERION>
+const std::vector<typename CRITERION::TARGET>& DATASET<T>::row_targets() const {
+  if constexpr (CRITERION::classification)
+    return labels;
+  else
+    return targets;
+}
+template<typename T>
+template<typename CRITERION>
+typename CRITERION::STATS DATASET<T>::stats(std::span<const size_t> rows) const {
+  typename CRITERION::STATS row_stats(classes.size());
+  const auto& row_target = row_targets<CRITERION>();
+  for(size_t row : rows)
+    row_stats.add(row_target[row], weights[row]);
+  return row_stats;
+}
+
+// QUESTION Definitions
+template<typename T>
+QUESTION<T>::QUESTION() : _column{0}, _value{T()}, _missing_true{false} {}
+template<typename T>
+QUESTION<T>::QUESTION(int column, T value, bool missing_true) : _column{column}, _value{value}, _missing_true{missing_true} {}
+template<typename T>
+QUESTION<T>::QUESTION(int column, CATEGORY_SET categories, std::shared_ptr<const DICTIONARY> dictionary) : 
+  _column{column}, _value{T()}, _missing_true{false}, _categories{std::move(categories)}, _dictionary{std::move(dictionary)} {}
+template<typename T>
+QUESTION<T>::QUESTION(int column, std::vector<uint32_t> branches, std::shared_ptr<const DICTIONARY> dictionary) : 
+  _column{column}, _value{T()}, _missing_true{false}, _branches{std::move(branches)}, _dictionary{std::move(dictionary)} {}
+template<typename T>
+size_t QUESTION<T>::branches() const {
+  return multiway() ? *std::max_element(_branches.begin(), _branches.end()) + 1 : 2;
+}
+template<typename T>
+bool QUESTION<T>::operator()(const DATA<T>& td) const {
+  return answer(td[_column]);
+}
+template<typename T>
+template<typename V>
+bool QUESTION<T>::answer(const V& feature) const {
+  if(!_categories.empty())
+    return _categories.contains(_category_of(feature));
+
+  // Bitwise operators, so a missing feature costs no branch
+  if constexpr (std::is_same_v<V, T>)
+    return ask(feature, _value) | (_missing_true & missing(feature));
+  else if constexpr (std::is_same_v<T, FEATURE>)
+    return ask(feature, std::get<V>(_value)) | (_missing_true & missing(feature));
+  else
+    return false; // Encoded features only ever meet the membership questions built by split search
+}
+template<typename T>
+template<typename V>
+CATEGORY_ID QUESTION<T>::_category_of(const V& feature) const {
+  if constexpr (std::is_same_v<V, CATEGORY_ID>) {
+    return feature;
+  } else if constexpr (std::is_same_v<V, std::string>) {
+    return _dictionary ? _dictionary->find(feature) : UNKNOWN_CATEGORY;
+  } else if constexpr (std::is_same_v<V, FEATURE>) {
+    if(auto id = std::get_if<CATEGORY>(&feature))
+      return *id;
+    if(auto name = std::get_if<STRING>(&feature); name && _dictionary)
+      return _dictionary->find(*name);
+    return UNKNOWN_CATEGORY;
+  } else {
+    return UNKNOWN_CATEGORY;
+  }
+}
+template<typename T>
+bool QUESTION<T>::ordered() const {
+  if(!_categories.empty() || multiway())
+    return false;
+
+  if constexpr (std::is_same_v<T, FEATURE>)
+    return _value.index() == FLOAT || _value.index() == INT;
+  else
+    return std::is_arithmetic_v<T>;
+}
+template<typename T>
+bool QUESTION<T>::operator()(const DATA<T>& td, enum COND M) const {
   T val = td[_column];
   switch(M) {
     case EQ:
@@ -290,175 +1987,2120 @@ bool QUESTION<T>::operator()(const DATA<T>& td, enum COND M) const {
   }
 }
 
+// NODE_ARENA Definitions
+template<typename T>
+size_t NODE_ARENA<T>::add_nodes(size_t amount) {
+  size_t first = nodes.size();
+  nodes.resize(first + amount);
+  counts.resize(nodes.size() * classes.size(), 0.0);
+  probabilities.resize(nodes.size() * classes.size(), 0.0f);
+  return first;
+}
+template<typename T>
+std::span<const double> NODE_ARENA<T>::counts_of(size_t node) const {
+  return std::span<const double>(counts.data() + node * classes.size(), classes.size());
+}
+template<typename T>
+std::span<const float> NODE_ARENA<T>::probabilities_of(size_t node) const {
+  return std::span<const float>(probabilities.data() + node * classes.size(), classes.size());
+}
+template<typename T>
+std::span<const size_t> NODE_ARENA<T>::rows_of(size_t node) const {
+  return std::span<const size_t>(rows.data() + nodes[node].rows_begin, nodes[node].rows_end - nodes[node].rows_begin);
+}
+
 // NODE_DATA Definitions
 template<typename T>
-NODE_DATA<T>::NODE_DATA(
-    double gini,
-    std::shared_ptr<TDATA_COL<T>> tdc_sptr,
-    std::shared_ptr<CLASS_COUNT> cnt_sptr,
-    std::shared_ptr<PRES_CONFIDENCE> cnf_sptr
-    ) : impurity{gini}, tdatacol_sptr{tdc_sptr}, count_sptr{cnt_sptr}, confidence_sptr{cnf_sptr} {}
-template<typename T>
-NODE_DATA<T>::NODE_DATA(const NODE_DATA &nodedata) : 
-  impurity{nodedata.impurity}, 
-  tdatacol_sptr{nodedata.tdatacol_sptr},
-  count_sptr{nodedata.count_sptr},
-  confidence_sptr{nodedata.confidence_sptr} 
-{
-  //std::cout << "NODE_DATA COPY CONSTRUCTED" << std::endl; // DELETE LATER
+NODE_DATA<T>::NODE_DATA(const NODE_ARENA<T>& node_arena, size_t node) : 
+  impurity{node_arena.nodes[node].impurity}, 
+  weight{node_arena.nodes[node].weight}, 
+  value{node_arena.nodes[node].value}, 
+  prune_alpha{node_arena.nodes[node].prune_alpha}, 
+  counts{node_arena.counts_of(node)}, 
+  probabilities{node_arena.probabilities_of(node)}, 
+  rows{node_arena.rows_of(node)}, 
+  arena{&node_arena} {}
+template<typename T>
+CLASS_COUNT NODE_DATA<T>::count() const {
+  CLASS_COUNT data_counts{0};
+  for(size_t class_id = 0; class_id < counts.size(); ++class_id)
+    if(counts[class_id] > 0)
+      data_counts[arena->classes[class_id]] = std::llround(counts[class_id]);
+  return data_counts;
 }
 template<typename T>
-NODE_DATA<T>::NODE_DATA(NODE_DATA &&nodedata) : 
-  impurity{nodedata.impurity}, 
-  tdatacol_sptr{std::move(nodedata.tdatacol_sptr)},
-  count_sptr{std::move(nodedata.count_sptr)},
-  confidence_sptr{std::move(nodedata.confidence_sptr)} 
-{
-  //std::cout << "NODE_DATA MOVE CONSTRUCTED" << std::endl; // DELETE LATER
-  nodedata.impurity = 0.0;
+PRES_CONFIDENCE NODE_DATA<T>::confidence() const {
+  PRES_CONFIDENCE data_confidence{0};
+  for(size_t class_id = 0; class_id < probabilities.size(); ++class_id)
+    if(probabilities[class_id] > 0)
+      data_confidence[arena->classes[class_id]] = probabilities[class_id];
+  return data_confidence;
 }
 template<typename T>
-void NODE_DATA<T>::operator=(const NODE_DATA& nodedata) {
-  //std::cout << "NODE_DATA COPY ASSIGNED" << std::endl;
-  impurity = nodedata.impurity;      
-  tdatacol_sptr = nodedata.tdatacol_sptr;
-  count_sptr = nodedata.count_sptr;
-  confidence_sptr = nodedata.confidence_sptr;
+TDATA_COL<T> NODE_DATA<T>::tdatacol() const {
+  return tdatacol(arena->training_data); // Empty unless kept; trees trained from a CSC_MATRIX never keep it
 }
 template<typename T>
-void NODE_DATA<T>::operator=(NODE_DATA &&nodedata) {
-  //std::cout << "NODE_DATA MOVE ASSIGNED" << std::endl;
-  impurity = nodedata.impurity;
-  tdatacol_sptr = std::move(nodedata.tdatacol_sptr);
-  count_sptr = std::move(nodedata.count_sptr);
-  confidence_sptr = std::move(nodedata.confidence_sptr);
-  nodedata.impurity = 0.0;
+TDATA_COL<T> NODE_DATA<T>::tdatacol(const TDATA_COL<T>& training_data) const {
+  TDATA_COL<T> tdatacol;
+  if(training_data.empty())
+    return tdatacol;
+  tdatacol.reserve(rows.size());
+  for(size_t row : rows)
+    tdatacol.push_back(training_data[row]);
+  return tdatacol;
 }
 
 // DECISION_NODE Definitions
 template<typename T>
-DECISION_NODE<T>::DECISION_NODE(
-    std::shared_ptr<NODE_DATA<T>> nodedata_sptr,
-    std::shared_ptr<QUESTION<T>> question_sptr,
-    std::shared_ptr<DECISION_NODE> true_branch_sptr,
-    std::shared_ptr<DECISION_NODE> false_branch_sptr
-    ) : _nodedata_sptr{nodedata_sptr}, _question_sptr{question_sptr}, _true_branch_sptr{true_branch_sptr}, _false_branch_sptr{false_branch_sptr} {}
+NODE_DATA<T> DECISION_NODE<T>::nodedata() const { return NODE_DATA<T>(*_arena, _index); }
 template<typename T>
-NODE_DATA<T> DECISION_NODE<T>::nodedata() const { return *_nodedata_sptr; }
+const QUESTION<T>& DECISION_NODE<T>::question() const { return _node().question; }
 template<typename T>
-QUESTION<T> DECISION_NODE<T>::question() const { return *_question_sptr; }
+DECISION_NODE<T> DECISION_NODE<T>::true_branch() const { return DECISION_NODE(_arena, _node().true_branch); }
 template<typename T>
-DECISION_NODE<T> DECISION_NODE<T>::true_branch() const { return *_true_branch_sptr; }
+DECISION_NODE<T> DECISION_NODE<T>::false_branch() const { return DECISION_NODE(_arena, _node().false_branch); }
 template<typename T>
-DECISION_NODE<T> DECISION_NODE<T>::false_branch() const { return *_false_branch_sptr; }
+size_t DECISION_NODE<T>::branches() const { return _node().branches; }
 template<typename T>
-bool DECISION_NODE<T>::is_leaf() const { return !_true_branch_sptr && !_false_branch_sptr; }
+DECISION_NODE<T> DECISION_NODE<T>::branch(size_t index) const { return DECISION_NODE(_arena, _node().true_branch + index); }
+template<typename T>
+bool DECISION_NODE<T>::is_leaf() const { return _node().is_leaf(); }
 
 
 // TREE Definitions
-template<typename T>
-TREE<T>::TREE(TDATA_COL<T>& training_data) : _training_data{training_data} {
-  this->_dtree = this->_build_tree(training_data);
+template<typename T, typename PROFILE, typename CRITERION>
+TREE<T, PROFILE, CRITERION>::TREE(TDATA_COL<T>& training_data, TREE_OPTIONS options, std::span<const double> sample_weights) : 
+  _dataset{training_data}, _options{options}, _node_count{1}, _arena{std::make_shared<NODE_ARENA<T>>()}
+{
+  static_assert(CRITERION::classification, "Regression trees are given their targets");
+  if(_options.keep_training_data)
+    _arena->training_data = training_data;
+  _fit(sample_weights);
 }
 
-template<typename T> 
-std::shared_ptr<DECISION_NODE<T>> TREE<T>::_build_tree(TDATA_COL<T>& tdatacol) {
-  auto [info_gain, question] = find_best_split(tdatacol);
-
-  NODE_DATA<T> nodedata( 
-      info_gain, 
-      std::make_shared<TDATA_COL<T>>(tdatacol),
-      std::make_shared<CLASS_COUNT>(tdatacol.count())
-      );
-
-  if(info_gain == 0) 
-    return std::make_shared<DECISION_NODE<T>>(std::make_shared<NODE_DATA<T>>(std::move(nodedata)));
+template<typename T, typename PROFILE, typename CRITERION>
+TREE<T, PROFILE, CRITERION>::TREE(TDATA_COL<T>& training_data, std::span<const double> targets, TREE_OPTIONS options, 
+    std::span<const double> sample_weights) : 
+  _dataset{training_data}, _options{options}, _node_count{1}, _arena{std::make_shared<NODE_ARENA<T>>()}
+{
+  static_assert(!CRITERION::classification, "Classification trees read their labels from the training data");
+  if(targets.size() != training_data.size())
+    throw std::invalid_argument("TREE: regression needs one target per row of training_data");
+  _dataset.set_targets(targets);
+  if(_options.keep_training_data)
+    _arena->training_data = training_data;
+  _fit(sample_weights);
+}
 
-  auto [true_rows, false_rows] = partition<T>(tdatacol, question);
+template<typename T, typename PROFILE, typename CRITERION>
+TREE<T, PROFILE, CRITERION>::TREE(const CSC_MATRIX<T>& training_data, std::span<const LABEL> labels, TREE_OPTIONS options, 
+    std::span<const double> sample_weights) : 
+  _dataset{training_data, labels, CRITERION::subtractive}, _options{options}, _node_count{1}, _arena{std::make_shared<NODE_ARENA<T>>()}
+{
+  _fit(sample_weights);
+}
 
-  std::shared_ptr<DECISION_NODE<T>> true_branch = _build_tree(true_rows);
-  std::shared_ptr<DECISION_NODE<T>> false_branch = _build_tree(false_rows);
+template<typename T, typename PROFILE, typename CRITERION>
+TREE<T, PROFILE, CRITERION>::TREE(DATASET<T> dataset, std::shared_ptr<NODE_ARENA<T>> arena) : 
+  _dataset{std::move(dataset)}, _node_count{arena->nodes.size()}, _arena{std::move(arena)}
+{
+  _gain_importances.assign(_dataset.col_size(), 0.0);
+  _split_counts.assign(_dataset.col_size(), 0);
+  _count_splits(0);
+  _compute_pruning_path();
+  _dataset.drop_rows();
 
-  return std::make_shared<DECISION_NODE<T>>(
-      std::make_shared<NODE_DATA<T>>(std::move(nodedata)), 
-      std::make_shared<QUESTION<T>>(question), true_branch, false_branch
-      );
+  if constexpr (PROFILE::predict)
+    _predict_registry = std::make_shared<PREDICT_REGISTRY>(_arena->nodes.size());
 }
 
-template<typename T>
-DECISION_NODE<T> TREE<T>:: predict(DATA<T> data) const {
-  return _find_best_answer(data, *_dtree);
-}
+template<typename T, typename PROFILE, typename CRITERION>
+void TREE<T, PROFILE, CRITERION>::_fit(std::span<const double> sample_weights) {
+  _dataset.reweigh(sample_weights, _options.class_weights);
+  if(_options.bundle_features)
+    _dataset.bundle_features();
 
-template<typename T>
-DECISION_NODE<T> TREE<T>::_find_best_answer(const DATA<T>& data, const DECISION_NODE<T>& node) const {
-  if(node.is_leaf()) 
-    return node;
+  _arena->classes = _dataset.classes;
+  _gain_importances.assign(_dataset.col_size(), 0.0);
+  _split_counts.assign(_dataset.col_size(), 0);
+  for(size_t row = 0; row < _dataset.size(); ++row)
+    if(_dataset.weights[row] > 0)
+      _arena->rows.push_back(row);
 
-  if(node.question()(data)) 
-    return _find_best_answer(data, node.true_branch());
-  else 
-    return _find_best_answer(data, node.false_branch());
-}
+  BUILD_STATE state;
+  state.scratch.reserve(_dataset.size());
+  state.empty_stats = typename CRITERION::STATS(_dataset.classes.size());
 
+  if(_options.subsampled()) {
+    state.engine.seed(_options.seed);
+    sample_in_place(_arena->rows, sample_size(_arena->rows.size(), _options.subsample), state.engine);
 
-// Function Definitions
-template<typename T>
-double gini(const TDATA_COL<T>& r) {
-  auto counts = r.count();
-  double impurity = 1.0;
-  for(const auto& [_name, amount] : counts) {
-    double correct_label_probability = amount / ((double) r.size()); 
-    impurity -= pow(correct_label_probability, 2.0);
+    state.tree_columns.resize(_dataset.col_size());
+    std::iota(state.tree_columns.begin(), state.tree_columns.end(), 0);
+    sample_in_place(state.tree_columns, sample_size(_dataset.col_size(), _options.colsample_bytree), state.engine);
   }
 
-  return impurity;
-}
+  size_t root = _arena->add_nodes(1);
+  _arena->nodes[root].rows_end = _arena->rows.size();
 
-template<typename T>
-std::pair<TDATA_COL<T>, TDATA_COL<T>> partition(const TDATA_COL<T>& r, const QUESTION<T>& q) {
-  TDATA_COL<T> true_rows, false_rows;
+  if(_options.presort) {
+    state.sorted.resize(_dataset.col_size());
+    state.sorted_rows.resize(_dataset.col_size());
+    state.sides.resize(_dataset.size());
 
-  for(const auto& x : r) {
-    if(q(x))
-      true_rows.push_back(x);
-    else
-      false_rows.push_back(x);
+    for(size_t column_idx = 0; column_idx < _dataset.col_size(); ++column_idx) {
+      if(_dataset.bundled(column_idx) || _dataset.is_sparse(column_idx))
+        continue; // Searched through its bundle or its entries, which need no sorted rows
+
+      visit_column(_dataset.columns[column_idx], [&](const auto& values) {
+        using V = typename std::decay_t<decltype(values)>::value_type;
+        if constexpr (std::is_arithmetic_v<V>) {
+          std::vector<size_t>& sorted = state.sorted[column_idx];
+          sorted = _arena->rows;
+          std::stable_sort(sorted.begin(), sorted.end(), [&](size_t a, size_t b) { return value_less(values[a], values[b]); });
+        }
+      });
+    }
   }
-  return {true_rows, false_rows};
-}
 
-template<typename T>
-double info_gain(const TDATA_COL<T>& left, const TDATA_COL<T>& right, double base_impurity) {
-  int left_size = left.size();
-  double item_ratio = ((double) left_size) / (left_size + right.size());
+  this->_build_tree(root, state);
+  _compute_pruning_path();
+  _dataset.drop_rows();
 
-  return base_impurity - item_ratio * gini(left) - (1 - item_ratio) * gini(right);
-};
+  if constexpr (PROFILE::predict)
+    _predict_registry = std::make_shared<PREDICT_REGISTRY>(_arena->nodes.size());
+}
 
-template<typename T, enum MODE>
-std::pair<double, QUESTION<T>> find_best_split(const TDATA_COL<T>& tdatacol) {
-  double best_gain = 0.0,
-         root_impurity = gini(tdatacol);
-  int column_size = tdatacol.col_size();
+template<typename T, typename PROFILE, typename CRITERION>
+void TREE<T, PROFILE, CRITERION>::_build_tree(size_t node, BUILD_STATE& state, size_t depth) {
+  NODE_ARENA<T>& arena = *_arena;
+  size_t rows_begin = arena.nodes[node].rows_begin, rows_end = arena.nodes[node].rows_end;
+  std::span<size_t> rows(arena.rows.data() + rows_begin, rows_end - rows_begin);
 
-  QUESTION<T> best_question; 
+  // A split adds two nodes, so it needs room for both of them in the budget
+  bool can_split = depth < _options.max_depth 
+    && rows.size() >= _options.min_samples_split
+    && rows.size() >= 2 * _options.min_samples_leaf
+    && _node_count + 2 <= _options.max_nodes;
 
-  for(int column_idx = 0; column_idx < column_size; ++column_idx) {
-    for(const auto& tdata : tdatacol) {
-      double gain {0.0};
-      QUESTION<T> q{column_idx, tdata[0]};
-      auto [true_rows, false_rows] = partition<T>(tdatacol, q);
+  double info_gain = 0.0;
+  QUESTION<T> question;
 
-      if(true_rows.size() == 0 || false_rows.size() == 0)
-        continue;
+  if(can_split) {
+    SCOPED_TIMER<PROFILE::train> timer(_train_stats.split_search_ns);
+    for(size_t column_idx = 0; column_idx < state.sorted_rows.size(); ++column_idx)
+      if(!state.sorted[column_idx].empty())
+        state.sorted_rows[column_idx] = std::span<const size_t>(state.sorted[column_idx].data() + rows_begin, rows.size());
+    if(_dataset.sparse.col_size() > 0)
+      state.node_rows.mark(rows, _dataset.size());
 
-      gain = info_gain(true_rows, false_rows, root_impurity);
-      if(best_gain <= gain) {
-        best_gain = gain;
-        best_question = q;
+    if(_options.subsampled()) {
+      // Levels draw their columns the first time the depth-first walk reaches them
+      while(state.level_columns.size() <= depth) {
+        state.level_columns.push_back(state.tree_columns);
+        sample_in_place(state.level_columns.back(), sample_size(state.tree_columns.size(), _options.colsample_bylevel), state.engine);
       }
+
+      const std::vector<size_t>& level = state.level_columns[depth];
+      state.node_columns = level;
+      size_t node_size = std::min(sample_size(level.size(), _options.colsample_bynode), std::max<size_t>(_options.max_features, 1));
+      sample_in_place(state.node_columns, node_size, state.engine);
     }
+
+    if(_options.mode == MULTIPLE)
+      std::tie(info_gain, question) = find_best_split<T, MULTIPLE, CRITERION>(
+          _dataset, rows, _options, PROFILE::train ? &_train_stats : nullptr, state.sorted_rows, state.node_columns, 
+          &state.node_rows);
+
+    // A k-ary split with more children than the node budget has room for gives way to the best binary one
+    if(_options.mode != MULTIPLE || _node_count + question.branches() > _options.max_nodes)
+      std::tie(info_gain, question) = find_best_split<T, BINARY, CRITERION>(
+          _dataset, rows, _options, PROFILE::train ? &_train_stats : nullptr, state.sorted_rows, state.node_columns, 
+          &state.node_rows);
+  }
+
+  {
+    SCOPED_TIMER<PROFILE::train> timer(_train_stats.impurity_ns);
+    typename CRITERION::STATS& stats = state.node_stats;
+    stats = state.empty_stats;
+    const auto& targets = _dataset.template row_targets<CRITERION>();
+    for(size_t row : rows)
+      stats.add(targets[row], _dataset.weights[row]);
+    double weight = stats.weight;
+    arena.nodes[node].weight = weight;
+    arena.nodes[node].impurity = CRITERION::impurity(stats);
+
+    if constexpr (CRITERION::classification) {
+      double* counts = arena.counts.data() + node * arena.classes.size();
+      std::copy(stats.counts.begin(), stats.counts.end(), counts);
+      arena.nodes[node].label = std::max_element(counts, counts + arena.classes.size()) - counts;
+
+      float* probabilities = arena.probabilities.data() + node * arena.classes.size();
+      for(size_t class_id = 0; weight > 0 && class_id < arena.classes.size(); ++class_id)
+        probabilities[class_id] = counts[class_id] / weight;
+    } else {
+      arena.nodes[node].value = CRITERION::value(stats);
+    }
+  }
+
+  double weighted_gain = info_gain * arena.nodes[node].weight / arena.nodes[0].weight;
+
+  if constexpr (PROFILE::train)
+    _train_stats.nodes += 1;
+
+  if(info_gain == 0 || weighted_gain < _options.min_impurity_decrease) 
+    return;
+
+  arena.nodes[node].gain = weighted_gain;
+  _gain_importances[question.column()] += weighted_gain;
+  _split_counts[question.column()] += 1;
+
+  std::vector<size_t>& sizes = state.branch_sizes;
+  {
+    SCOPED_TIMER<PROFILE::train> timer(_train_stats.partition_ns);
+    if(question.multiway()) {
+      partition<T>(_dataset, rows, question, state.scratch, sizes);
+    } else {
+      size_t true_size = partition<T>(_dataset, rows, question, state.scratch, &state.node_rows);
+      sizes.assign({true_size, rows.size() - true_size});
+    }
+
+    // Every sorted column splits the same way; stable partitions keep each child in value order
+    if(!state.sorted.empty()) {
+      for(size_t child = 0, i = 0; child < sizes.size(); ++child)
+        for(size_t end = i + sizes[child]; i < end; ++i)
+          state.sides[rows[i]] = child;
+
+      if(sizes.size() == 2) {
+        for(std::vector<size_t>& sorted : state.sorted) {
+          if(sorted.empty())
+            continue;
+
+          state.scratch.clear();
+          size_t kept = rows_begin;
+          for(size_t i = rows_begin; i < rows_end; ++i) {
+            if(state.sides[sorted[i]] == 0)
+              sorted[kept++] = sorted[i];
+            else
+              state.scratch.push_back(sorted[i]);
+          }
+          std::copy(state.scratch.begin(), state.scratch.end(), sorted.begin() + kept);
+        }
+      } else {
+        std::vector<size_t> ends(sizes.size());
+        for(std::vector<size_t>& sorted : state.sorted) {
+          if(sorted.empty())
+            continue;
+
+          std::partial_sum(sizes.begin(), sizes.end(), ends.begin());
+          state.scratch.assign(sorted.begin() + rows_begin, sorted.begin() + rows_end);
+          for(size_t i = state.scratch.size(); i-- > 0;)
+            sorted[rows_begin + --ends[state.sides[state.scratch[i]]]] = state.scratch[i];
+        }
+      }
+    }
+  }
+
+  if constexpr (PROFILE::train) {
+    _train_stats.rows_copied += rows.size();
+    size_t partition_bytes = state.scratch.capacity() * sizeof(size_t) + state.sides.capacity() * sizeof(uint32_t)
+      + sizes.capacity() * sizeof(size_t);
+    _train_stats.peak_node_bytes = std::max(_train_stats.peak_node_bytes, partition_bytes);
+  }
+
+  // Growing the arena moves its nodes, so they are only ever reached by index. Children are adjacent,
+  // so k-ary nodes jump to their first child plus the offset their question looks up.
+  size_t branches = sizes.size();
+  size_t first_branch = arena.add_nodes(branches);
+
+  arena.nodes[node].question = std::move(question);
+  arena.nodes[node].true_branch = first_branch;
+  arena.nodes[node].false_branch = first_branch + 1;
+  arena.nodes[node].branches = branches;
+  for(size_t child = 0, begin = rows_begin; child < branches; ++child) {
+    arena.nodes[first_branch + child].rows_begin = begin;
+    arena.nodes[first_branch + child].rows_end = begin += sizes[child];
+  }
+
+  _node_count += branches; // Reserve every child before any subtree spends the budget
+  for(size_t child = 0; child < branches; ++child)
+    _build_tree(first_branch + child, state, depth + 1);
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+void TREE<T, PROFILE, CRITERION>::_compute_pruning_path() {
+  // The root's cost function breaks exactly at the alphas where the optimal subtree loses leaves
+  for(const auto& segment : _cost_complexity(0, _arena->nodes[0].weight)) {
+    _pruning_path.alphas.push_back(segment.alpha);
+    _pruning_path.impurities.push_back(segment.risk);
+    _pruning_path.leaves.push_back(segment.leaves);
+  }
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+std::vector<typename TREE<T, PROFILE, CRITERION>::PRUNE_SEGMENT> TREE<T, PROFILE, CRITERION>::_cost_complexity(size_t node, double total_weight) {
+  NODE<T>& tree_node = _arena->nodes[node];
+  double risk = tree_node.impurity * tree_node.weight / total_weight;
+
+  if(tree_node.is_leaf())
+    return {{0.0, risk, 1}};
+
+  // Cost of keeping this node internal: sum of its children over the union of their breakpoints,
+  // added one child at a time
+  const double infinity = std::numeric_limits<double>::infinity();
+  std::vector<PRUNE_SEGMENT> segments = _cost_complexity(tree_node.true_branch, total_weight);
+
+  for(size_t child = 1; child < tree_node.branches; ++child) {
+    auto true_segments = std::move(segments);
+    auto false_segments = _cost_complexity(tree_node.true_branch + child, total_weight);
+    segments.clear();
+    size_t t = 0, f = 0;
+
+    while(t < true_segments.size() && f < false_segments.size()) {
+      segments.push_back({
+          std::max(true_segments[t].alpha, false_segments[f].alpha),
+          true_segments[t].risk + false_segments[f].risk,
+          true_segments[t].leaves + false_segments[f].leaves
+          });
+
+      double next_t = t + 1 < true_segments.size() ? true_segments[t + 1].alpha : infinity;
+      double next_f = f + 1 < false_segments.size() ? false_segments[f + 1].alpha : infinity;
+      if(next_t <= next_f) ++t;
+      if(next_f <= next_t) ++f;
+    }
+  }
+
+  // Collapsing costs risk + alpha. The gap to the subtree cost only shrinks as alpha grows,
+  // so the first segment that reaches it gives the collapse point.
+  size_t i = 0;
+  double collapse_alpha = infinity;
+
+  for(; i < segments.size(); ++i) {
+    double end = i + 1 < segments.size() ? segments[i + 1].alpha : infinity;
+    double alpha = (risk - segments[i].risk) / (segments[i].leaves - 1);
+
+    if(alpha <= end) {
+      collapse_alpha = std::max(alpha, segments[i].alpha);
+      break;
+    }
+  }
+
+  if(i < segments.size() && segments[i].alpha >= collapse_alpha)
+    segments.resize(i);
+  else
+    segments.resize(i + 1);
+
+  segments.push_back({collapse_alpha, risk, 1});
+  tree_node.prune_alpha = collapse_alpha;
+
+  return segments;
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+void TREE<T, PROFILE, CRITERION>::prune(double alpha) {
+  if(!_arena)
+    return;
+
+  // Copies of this tree keep the nodes they were made with
+  if(_arena.use_count() > 1)
+    _arena = std::make_shared<NODE_ARENA<T>>(*_arena);
+
+  _node_count = _prune(0, alpha);
+
+  // Recounted in the order training added them, so an unpruned subtree contributes the same sums
+  std::fill(_gain_importances.begin(), _gain_importances.end(), 0.0);
+  std::fill(_split_counts.begin(), _split_counts.end(), 0);
+  _count_splits(0);
+
+  // The pruned tree keeps the tail of the path, with the segment containing alpha now starting at zero
+  size_t first = 0;
+  while(first + 1 < _pruning_path.alphas.size() && _pruning_path.alphas[first + 1] <= alpha)
+    ++first;
+
+  _pruning_path.alphas.erase(_pruning_path.alphas.begin() + 1, _pruning_path.alphas.begin() + first + 1);
+  _pruning_path.impurities.erase(_pruning_path.impurities.begin(), _pruning_path.impurities.begin() + first);
+  _pruning_path.leaves.erase(_pruning_path.leaves.begin(), _pruning_path.leaves.begin() + first);
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+size_t TREE<T, PROFILE, CRITERION>::_prune(size_t node, double alpha) {
+  NODE<T>& tree_node = _arena->nodes[node];
+
+  if(tree_node.is_leaf())
+    return 1;
+
+  // Collapsed subtrees stay in the arena unreachable, so ids keep naming the same nodes
+  if(tree_node.prune_alpha <= alpha) {
+    tree_node.question = QUESTION<T>();
+    tree_node.true_branch = NO_NODE;
+    tree_node.false_branch = NO_NODE;
+    tree_node.branches = 0;
+    return 1;
+  }
+
+  size_t kept = 1;
+  for(size_t child = 0; child < tree_node.branches; ++child)
+    kept += _prune(tree_node.true_branch + child, alpha);
+  return kept;
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+void TREE<T, PROFILE, CRITERION>::_count_splits(size_t node) {
+  const NODE<T>& tree_node = _arena->nodes[node];
+  if(tree_node.is_leaf())
+    return;
+
+  _gain_importances[tree_node.question.column()] += tree_node.gain;
+  _split_counts[tree_node.question.column()] += 1;
+  for(size_t child = 0; child < tree_node.branches; ++child)
+    _count_splits(tree_node.true_branch + child);
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+DECISION_NODE<T> TREE<T, PROFILE, CRITERION>:: predict(DATA<T> data) const {
+  if(!_arena)
+    return DECISION_NODE<T>(); // Default-constructed trees have neither nodes nor a registry
+
+  if constexpr (PROFILE::predict) {
+    auto start = std::chrono::steady_clock::now();
+    PREDICT_COUNTERS& counters = _predict_registry->local();
+    size_t leaf;
+
+    if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, FEATURE>)
+      leaf = _find_best_answer(_dataset.encode(data), &counters);
+    else
+      leaf = _find_best_answer(data, &counters);
+
+    counters.record_latency(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    return DECISION_NODE<T>(_arena.get(), leaf);
+  } else {
+    if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, FEATURE>)
+      return DECISION_NODE<T>(_arena.get(), _find_best_answer(_dataset.encode(data)));
+    else
+      return DECISION_NODE<T>(_arena.get(), _find_best_answer(data));
+  }
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+template<typename V, size_t EXTENT>
+DECISION_NODE<T> TREE<T, PROFILE, CRITERION>::predict(std::span<const V, EXTENT> row) const {
+  static_assert(std::is_same_v<V, T> || std::is_same_v<V, typename ENCODING<T>::type>, 
+      "predict() reads rows of the tree's feature type or of its encoding");
+  return _predict(row);
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+DECISION_NODE<T> TREE<T, PROFILE, CRITERION>::predict(const SPARSE_ROW<T>& row) const {
+  static_assert(std::is_arithmetic_v<T>, "Sparse rows need arithmetic features");
+  return _predict(row);
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+size_t TREE<T, PROFILE, CRITERION>::predict_class(const SPARSE_ROW<T>& row) const {
+  static_assert(CRITERION::classification, "predict_class() needs a classification tree");
+  return _arena->nodes[predict(row).id()].label;
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+double TREE<T, PROFILE, CRITERION>::predict_value(const SPARSE_ROW<T>& row) const {
+  static_assert(!CRITERION::classification, "predict_value() needs a regression tree");
+  return _arena->nodes[predict(row).id()].value;
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+void TREE<T, PROFILE, CRITERION>::predict_proba(const SPARSE_ROW<T>& row, std::span<float> probabilities) const {
+  std::span<const float> leaf = _arena->probabilities_of(predict(row).id());
+  std::copy(leaf.begin(), leaf.end(), probabilities.begin());
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+void TREE<T, PROFILE, CRITERION>::predict_class(const CSR_MATRIX<T>& matrix, std::span<size_t> row_classes) const {
+  for(size_t r = 0; r < matrix.size(); ++r)
+    row_classes[r] = predict_class(matrix.row(r));
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+void TREE<T, PROFILE, CRITERION>::predict_class(const TDATA_COL<T>& data, std::span<size_t> row_classes, size_t threads) const {
+  static_assert(CRITERION::classification, "predict_class() needs a classification tree");
+  parallel_for(data.size(), threads, [&](size_t begin, size_t end) {
+    for(size_t r = begin; r < end; ++r)
+      row_classes[r] = _arena->nodes[_predict(data[r]).id()].label;
+  });
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+void TREE<T, PROFILE, CRITERION>::predict_value(const TDATA_COL<T>& data, std::span<double> row_values, size_t threads) const {
+  static_assert(!CRITERION::classification, "predict_value() needs a regression tree");
+  parallel_for(data.size(), threads, [&](size_t begin, size_t end) {
+    for(size_t r = begin; r < end; ++r)
+      row_values[r] = _arena->nodes[_predict(data[r]).id()].value;
+  });
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+std::vector<double> TREE<T, PROFILE, CRITERION>::permutation_importance(
+    const TDATA_COL<T>& data, std::span<const double> targets, size_t repeats, uint64_t seed, size_t threads) const {
+  if constexpr (CRITERION::classification) {
+    if(!targets.empty())
+      throw std::invalid_argument("permutation_importance: classification reads the labels of data, not targets");
+  } else {
+    if(targets.size() != data.size())
+      throw std::invalid_argument("permutation_importance: regression needs one target per row of data");
+  }
+
+  size_t columns = _gain_importances.size();
+  std::vector<double> importances(columns, 0.0);
+  if(data.empty() || repeats == 0)
+    return importances;
+
+  // Reads one column from the row it was shuffled to, every other from the row itself
+  struct SHUFFLED_ROW {
+    const DATA<T>& row;
+    const DATA<T>& donor;
+    size_t column;
+
+    const T& operator[](size_t c) const { return c == column ? donor[c] : row[c]; }
+  };
+
+  // Accuracy, or negated mean squared error, of the leaves reached by rows
+  std::vector<size_t> expected;
+  if constexpr (CRITERION::classification) {
+    std::unordered_map<std::string, size_t> class_ids;
+    for(size_t class_id = 0; class_id < classes().size(); ++class_id)
+      class_ids.emplace(classes()[class_id], class_id);
+    for(const auto& tdata : data) {
+      auto it = class_ids.find(tdata.label);
+      expected.push_back(it == class_ids.end() ? NO_NODE : it->second); // Never matched by a leaf
+    }
+  }
+  auto score = [&](auto&& row_at) {
+    double total = 0.0;
+    for(size_t r = 0; r < data.size(); ++r) {
+      const NODE<T>& leaf = _arena->nodes[_predict(row_at(r)).id()];
+      if constexpr (CRITERION::classification)
+        total += leaf.label == expected[r];
+      else
+        total -= (leaf.value - targets[r]) * (leaf.value - targets[r]);
+    }
+    return total / data.size();
+  };
+
+  double baseline = score([&](size_t r) -> const DATA<T>& { return data[r]; });
+
+  // Every shuffle draws from its own engine, so results do not depend on how tasks meet threads
+  size_t tasks = columns * repeats;
+  std::vector<double> drops(tasks);
+  parallel_for(tasks, threads, [&](size_t begin, size_t end) {
+    std::vector<size_t> order(data.size());
+    for(size_t task = begin; task < end; ++task) {
+      std::iota(order.begin(), order.end(), 0);
+      std::mt19937_64 engine(seed + task);
+      std::shuffle(order.begin(), order.end(), engine);
+
+      size_t column = task / repeats;
+      drops[task] = baseline - score([&](size_t r) { return SHUFFLED_ROW{data[r], data[order[r]], column}; });
+    }
+  });
+
+  for(size_t task = 0; task < tasks; ++task)
+    importances[task / repeats] += drops[task] / repeats;
+  return importances;
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+double TREE<T, PROFILE, CRITERION>::_leaf_output(size_t node, size_t output) const {
+  if constexpr (CRITERION::classification)
+    return _arena->probabilities_of(node)[output];
+  else
+    return _arena->nodes[node].value;
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+size_t TREE<T, PROFILE, CRITERION>::_shap_depth(size_t node) const {
+  const NODE<T>& tree_node = _arena->nodes[node];
+  size_t depth = 0;
+  for(size_t child = 0; child < tree_node.branches; ++child)
+    depth = std::max(depth, 1 + _shap_depth(tree_node.true_branch + child));
+  return depth;
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+void TREE<T, PROFILE, CRITERION>::_shap_expected(size_t node, std::span<double> expected) const {
+  const NODE<T>& tree_node = _arena->nodes[node];
+  if(tree_node.is_leaf()) {
+    double share = tree_node.weight / _arena->nodes[0].weight;
+    for(size_t output = 0; output < expected.size(); ++output)
+      expected[output] += share * _leaf_output(node, output);
+    return;
+  }
+
+  for(size_t child = 0; child < tree_node.branches; ++child)
+    _shap_expected(tree_node.true_branch + child, expected);
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+template<typename V, size_t EXTENT>
+void TREE<T, PROFILE, CRITERION>::shap_values(std::span<const V, EXTENT> row, std::span<double> contributions) const {
+  static_assert(std::is_same_v<V, T> || std::is_same_v<V, typename ENCODING<T>::type>, 
+      "shap_values() reads rows of the tree's feature type or of its encoding");
+  std::vector<SHAP_PATH_ELEMENT> path;
+  _shap(row, contributions, path);
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+void TREE<T, PROFILE, CRITERION>::shap_values(const TDATA_COL<T>& data, std::span<double> contributions, size_t threads) const {
+  if(data.empty())
+    return;
+
+  // The plan: path storage sized once for the deepest leaf, and the expected output every row shares
+  size_t outputs = shap_outputs(), stride = (_gain_importances.size() + 1) * outputs;
+  size_t depth = _shap_depth(0);
+  std::vector<double> expected(outputs, 0.0);
+  _shap_expected(0, expected);
+
+  parallel_for(data.size(), threads, [&](size_t begin, size_t end) {
+    std::vector<SHAP_PATH_ELEMENT> path((depth + 2) * (depth + 3) / 2);
+    for(size_t r = begin; r < end; ++r) {
+      std::span<double> row_contributions = contributions.subspan(r * stride, stride);
+      std::fill(row_contributions.begin(), row_contributions.end(), 0.0);
+      std::copy(expected.begin(), expected.end(), row_contributions.end() - outputs);
+      _shap_recurse(data[r], 0, row_contributions, path.data(), 0, 1.0, 1.0, NO_COLUMN);
+    }
+  });
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+template<typename ROW>
+void TREE<T, PROFILE, CRITERION>::_shap(const ROW& row, std::span<double> contributions, std::vector<SHAP_PATH_ELEMENT>& path) const {
+  size_t outputs = shap_outputs(), depth = _shap_depth(0);
+  std::fill(contributions.begin(), contributions.end(), 0.0);
+  _shap_expected(0, contributions.subspan(_gain_importances.size() * outputs, outputs));
+
+  // Each level of the recursion keeps its own copy of the path, one element longer than its parent's
+  path.resize((depth + 2) * (depth + 3) / 2);
+  _shap_recurse(row, 0, contributions, path.data(), 0, 1.0, 1.0, NO_COLUMN);
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+template<typename ROW>
+void TREE<T, PROFILE, CRITERION>::_shap_recurse(const ROW& row, size_t node, std::span<double> contributions, 
+    SHAP_PATH_ELEMENT* parent_path, size_t depth, double zero_fraction, double one_fraction, size_t column) const {
+  SHAP_PATH_ELEMENT* path = parent_path + depth + 1;
+  std::copy(parent_path, parent_path + depth + 1, path);
+  shap_extend(path, depth, zero_fraction, one_fraction, column);
+
+  const NODE<T>& tree_node = _arena->nodes[node];
+  size_t outputs = shap_outputs();
+  if(tree_node.is_leaf()) {
+    for(size_t i = 1; i <= depth; ++i) {
+      double scale = shap_unwound_sum(path, depth, i) * (path[i].one_fraction - path[i].zero_fraction);
+      for(size_t output = 0; output < outputs; ++output)
+        contributions[path[i].column * outputs + output] += scale * _leaf_output(node, output);
+    }
+    return;
+  }
+
+  const QUESTION<T>& question = tree_node.question;
+  const auto& feature = row[question.column()];
+  size_t hot = question.multiway() ? tree_node.true_branch + question.branch(feature)
+    : question.answer(feature) ? tree_node.true_branch : tree_node.false_branch;
+
+  // A column met again is taken off the path, and its fractions carried into this node's
+  double incoming_zero = 1.0, incoming_one = 1.0;
+  size_t split_column = question.column();
+  size_t index = 0;
+  while(index <= depth && path[index].column != split_column)
+    ++index;
+  if(index <= depth) {
+    incoming_zero = path[index].zero_fraction;
+    incoming_one = path[index].one_fraction;
+    shap_unwind(path, depth, index);
+    depth -= 1;
+  }
+
+  for(size_t child = tree_node.true_branch; child < tree_node.true_branch + tree_node.branches; ++child) {
+    double share = _arena->nodes[child].weight / tree_node.weight;
+    _shap_recurse(row, child, contributions, path, depth + 1, share * incoming_zero, child == hot ? incoming_one : 0.0, split_column);
+  }
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+template<typename ROW>
+DECISION_NODE<T> TREE<T, PROFILE, CRITERION>::_predict(const ROW& row) const {
+  if(!_arena)
+    return DECISION_NODE<T>();
+
+  if constexpr (PROFILE::predict) {
+    auto start = std::chrono::steady_clock::now();
+    PREDICT_COUNTERS& counters = _predict_registry->local();
+    size_t leaf = _find_best_answer(row, &counters);
+
+    counters.record_latency(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    return DECISION_NODE<T>(_arena.get(), leaf);
+  } else {
+    return DECISION_NODE<T>(_arena.get(), _find_best_answer(row));
+  }
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+template<typename V, size_t EXTENT>
+size_t TREE<T, PROFILE, CRITERION>::predict_class(std::span<const V, EXTENT> row) const {
+  static_assert(CRITERION::classification, "predict_class() needs a classification tree");
+  return _arena->nodes[predict(row).id()].label;
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+template<typename V, size_t EXTENT>
+double TREE<T, PROFILE, CRITERION>::predict_value(std::span<const V, EXTENT> row) const {
+  static_assert(!CRITERION::classification, "predict_value() needs a regression tree");
+  return _arena->nodes[predict(row).id()].value;
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+template<typename V, size_t EXTENT>
+void TREE<T, PROFILE, CRITERION>::predict_proba(std::span<const V, EXTENT> row, std::span<float> probabilities) const {
+  std::span<const float> leaf = _arena->probabilities_of(predict(row).id());
+  std::copy(leaf.begin(), leaf.end(), probabilities.begin());
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+template<typename ROW>
+size_t TREE<T, PROFILE, CRITERION>::_find_best_answer(const ROW& row, PREDICT_COUNTERS* counters) const {
+  const std::vector<NODE<T>>& nodes = _arena->nodes;
+  size_t node = 0, depth = 0;
+
+  for(;; ++depth) {
+    if constexpr (PROFILE::predict)
+      PREDICT_COUNTERS::bump(counters->node_visits[node]);
+
+    const NODE<T>& tree_node = nodes[node];
+    if(tree_node.is_leaf())
+      break;
+
+    const QUESTION<T>& question = tree_node.question;
+    const auto& feature = row[question.column()];
+    if(question.multiway())
+      node = tree_node.true_branch + question.branch(feature); // One indexed jump instead of a chain of equality questions
+    else
+      node = question.answer(feature) ? tree_node.true_branch : tree_node.false_branch;
+  }
+
+  if constexpr (PROFILE::predict)
+    counters->record_depth(depth);
+  return node;
+}
+
+
+// MODEL_HANDLE Definitions
+template<typename MODEL>
+MODEL_HANDLE<MODEL>::MODEL_HANDLE(MODEL model) : _current{new MODEL(std::move(model))} {}
+
+template<typename MODEL>
+MODEL_HANDLE<MODEL>::~MODEL_HANDLE() {
+  delete _current.load();
+}
+
+template<typename MODEL>
+template<typename READER>
+decltype(auto) MODEL_HANDLE<MODEL>::read(READER&& reader) const {
+  READER_EPOCH& slot = _readers.local();
+
+  // Sequentially consistent, so a writer that finds the slot idle has already swapped the pointer this read loads
+  if(slot.depth++ == 0)
+    slot.epoch.store(_epoch.load());
+  struct EXIT {
+    READER_EPOCH& slot;
+    ~EXIT() {
+      if(--slot.depth == 0)
+        slot.epoch.store(READER_EPOCH::idle, std::memory_order_release);
+    }
+  } exit{slot};
+
+  return reader(static_cast<const MODEL&>(*_current.load()));
+}
+
+template<typename MODEL>
+void MODEL_HANDLE<MODEL>::publish(MODEL model) {
+  MODEL* retired = _current.exchange(new MODEL(std::move(model)));
+  uint64_t epoch = _epoch.fetch_add(1) + 1;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _retired.push_back({std::unique_ptr<MODEL>(retired), epoch});
+  _reclaim();
+}
+
+template<typename MODEL>
+size_t MODEL_HANDLE<MODEL>::reclaim() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _reclaim();
+}
+
+template<typename MODEL>
+size_t MODEL_HANDLE<MODEL>::_reclaim() {
+  // Reads that could have loaded a retired model started before its epoch, and hold it until they end
+  uint64_t oldest = READER_EPOCH::idle;
+  _readers.visit([&](const READER_EPOCH& slot) { oldest = std::min(oldest, slot.epoch.load()); });
+
+  std::erase_if(_retired, [&](const RETIRED& retired) { return retired.epoch <= oldest; });
+  return _retired.size();
+}
+
+
+// HOEFFDING_TREE Definitions
+template<typename T, typename CRITERION>
+HOEFFDING_TREE<T, CRITERION>::HOEFFDING_TREE(HOEFFDING_OPTIONS options) : _options{options}, _nodes(1) {
+  if(_options.max_depth > 0 && _options.max_leaves > 1) {
+    _nodes[0].leaf = 0;
+    _leaves.push_back({0});
+  }
+}
+
+template<typename T, typename CRITERION>
+void HOEFFDING_TREE<T, CRITERION>::update(const TDATA<T>& tdata, double weight) {
+  size_t columns = tdata.size();
+  if(_schema.empty() && columns > 0) {
+    for(size_t column = 0; column < columns; ++column) {
+      if constexpr (std::is_same_v<T, FEATURE>)
+        _schema.push_back(COLTYPE(tdata[column].index()));
+      else
+        _schema.push_back(std::is_floating_point_v<T> ? FLOAT : std::is_integral_v<T> ? INT : STRING);
+      _dictionaries.push_back(_schema.back() == STRING ? std::make_shared<DICTIONARY>() : nullptr);
+    }
+  }
+
+  auto [it, inserted] = _class_ids.emplace(tdata.label, _classes.size());
+  if(inserted)
+    _classes.push_back(tdata.label);
+  size_t class_id = it->second;
+
+  auto learn = [&](const auto& row) {
+    size_t node = 0;
+    while(_nodes[node].true_branch != NO_NODE) {
+      const QUESTION<T>& question = _nodes[node].question;
+      node = _nodes[node].true_branch + !question.answer(row[question.column()]);
+    }
+
+    STREAM_NODE& tree_node = _nodes[node];
+    _grow(tree_node.stats);
+    tree_node.stats.add(class_id, weight);
+    if(tree_node.leaf == NO_NODE)
+      return;
+
+    LEAF& leaf = _leaves[tree_node.leaf];
+    _grow(leaf.seen);
+    leaf.seen.add(class_id, weight);
+    leaf.bins.resize(columns);
+    for(size_t column = 0; column < columns; ++column) {
+      double key = _key(row[column]);
+      if(!std::isnan(key))
+        _observe(leaf, column, key, class_id, weight);
+    }
+
+    if(leaf.seen.weight - leaf.checked >= _options.grace_period)
+      _attempt_split(tree_node.leaf);
+  };
+
+  // Strings become dictionary ids first, so leaves count categories and questions compare ids
+  if constexpr (std::is_same_v<T, std::string>) {
+    _encoded.resize(columns);
+    for(size_t column = 0; column < columns; ++column)
+      _encoded[column] = _dictionaries[column]->encode(tdata[column]);
+    learn(_encoded);
+  } else if constexpr (std::is_same_v<T, FEATURE>) {
+    _encoded.resize(columns);
+    for(size_t column = 0; column < columns; ++column) {
+      if(auto name = std::get_if<STRING>(&tdata[column]); name && _dictionaries[column])
+        _encoded[column] = _dictionaries[column]->encode(*name);
+      else
+        _encoded[column] = tdata[column];
+    }
+    learn(_encoded);
+  } else {
+    learn(tdata);
+  }
+}
+
+template<typename T, typename CRITERION>
+template<typename V>
+double HOEFFDING_TREE<T, CRITERION>::_key(const V& feature) {
+  if constexpr (std::is_same_v<V, CATEGORY_ID>) {
+    return static_cast<double>(feature);
+  } else if constexpr (std::is_same_v<V, FEATURE>) {
+    return std::visit([](const auto& value) -> double {
+      using A = std::decay_t<decltype(value)>;
+      if constexpr (std::is_same_v<A, std::string>)
+        return std::numeric_limits<double>::quiet_NaN();
+      else
+        return static_cast<double>(value);
+    }, feature);
+  } else {
+    return static_cast<double>(feature);
+  }
+}
+
+template<typename T, typename CRITERION>
+void HOEFFDING_TREE<T, CRITERION>::_observe(LEAF& leaf, size_t column, double key, size_t class_id, double weight) {
+  std::vector<BIN>& bins = leaf.bins[column];
+  auto bin = std::lower_bound(bins.begin(), bins.end(), key, [](const BIN& b, double k) { return b.key < k; });
+  if(bin == bins.end() || bin->key != key) {
+    if(!_ordered(column) && bins.size() >= _options.max_bins)
+      return;
+    bin = bins.insert(bin, {key, CLASS_STATS(_classes.size())});
+  }
+  _grow(bin->stats);
+  bin->stats.add(class_id, weight);
+
+  if(!_ordered(column) || bins.size() <= _options.max_bins)
+    return;
+
+  // The closest two bins merge into the upper one, so every bin still holds exactly the rows up to its key
+  size_t closest = 0;
+  for(size_t i = 1; i + 1 < bins.size(); ++i)
+    if(bins[i + 1].key - bins[i].key < bins[closest + 1].key - bins[closest].key)
+      closest = i;
+
+  _grow(bins[closest].stats);
+  _grow(bins[closest + 1].stats);
+  bins[closest + 1].stats.add(bins[closest].stats);
+  bins.erase(bins.begin() + closest);
+}
+
+template<typename T, typename CRITERION>
+void HOEFFDING_TREE<T, CRITERION>::_attempt_split(size_t leaf_index) {
+  LEAF& leaf = _leaves[leaf_index];
+  leaf.checked = leaf.seen.weight;
+  size_t classes = _classes.size();
+  if(classes < 2)
+    return;
+
+  const CLASS_STATS& seen = leaf.seen;
+  double root_impurity = CRITERION::impurity(seen);
+  auto gain_of = [&](const CLASS_STATS& true_side) {
+    CLASS_STATS false_side = seen;
+    false_side.subtract(true_side);
+    if(true_side.weight <= 0 || false_side.weight <= 0)
+      return 0.0;
+    return root_impurity - (CRITERION::impurity(true_side) * true_side.weight + CRITERION::impurity(false_side) * false_side.weight) / seen.weight;
+  };
+
+  // Best question of every column; not splitting at all scores 0
+  double best_gain = 0.0, second_gain = 0.0, best_key = 0.0;
+  size_t best_column = NO_COLUMN;
+  CLASS_STATS best_true, true_side;
+
+  for(size_t column = 0; column < leaf.bins.size(); ++column) {
+    double column_gain = 0.0, column_key = 0.0;
+    CLASS_STATS column_true;
+    true_side = CLASS_STATS(classes);
+
+    std::vector<BIN>& bins = leaf.bins[column];
+    for(size_t b = 0; b < bins.size(); ++b) {
+      _grow(bins[b].stats);
+      if(_ordered(column)) {
+        if(b + 1 == bins.size())
+          break;
+        true_side.add(bins[b].stats);
+      } else {
+        true_side = bins[b].stats;
+      }
+
+      double gain = gain_of(true_side);
+      if(gain > column_gain) {
+        column_gain = gain;
+        column_key = bins[b].key;
+        column_true = true_side;
+      }
+    }
+
+    if(column_gain > best_gain) {
+      second_gain = best_gain;
+      best_gain = column_gain;
+      best_key = column_key;
+      best_column = column;
+      best_true = std::move(column_true);
+    } else {
+      second_gain = std::max(second_gain, column_gain);
+    }
+  }
+
+  // Hoeffding bound on the gain difference, whose range is the impurity of evenly spread classes
+  CLASS_STATS uniform(classes);
+  std::fill(uniform.counts.begin(), uniform.counts.end(), 1.0);
+  uniform.weight = classes;
+  double bound = CRITERION::impurity(uniform) * std::sqrt(std::log(1 / _options.split_confidence) / (2 * seen.weight));
+  if(best_column == NO_COLUMN || (best_gain - second_gain <= bound && bound >= _options.tie_threshold))
+    return;
+
+  size_t parent = leaf.node;
+  CLASS_STATS best_false = seen;
+  best_false.subtract(best_true);
+
+  // The children start from the split of the parent's weight, scaled to include what the parent was
+  // started with, so leaves together weigh every row the tree has seen
+  _grow(_nodes[parent].stats);
+  double scale = _nodes[parent].stats.weight / seen.weight;
+  for(CLASS_STATS* side : {&best_true, &best_false}) {
+    for(double& count : side->counts)
+      count *= scale;
+    side->weight *= scale;
+  }
+
+  // The parent stops learning: the last leaf takes its slot
+  if(leaf_index + 1 < _leaves.size()) {
+    _leaves[leaf_index] = std::move(_leaves.back());
+    _nodes[_leaves[leaf_index].node].leaf = leaf_index;
+  }
+  _leaves.pop_back();
+
+  size_t first = _nodes.size();
+  _nodes.resize(first + 2);
+  _nodes[parent].question = _question(best_column, best_key);
+  _nodes[parent].true_branch = first;
+  _nodes[parent].leaf = NO_NODE;
+  _nodes[parent].stats = CLASS_STATS();
+  _nodes[first].stats = std::move(best_true);
+  _nodes[first + 1].stats = std::move(best_false);
+  _leaf_count += 1;
+
+  for(size_t child = first; child < first + 2; ++child) {
+    _nodes[child].depth = _nodes[parent].depth + 1;
+    if(_nodes[child].depth < _options.max_depth) {
+      _nodes[child].leaf = _leaves.size();
+      _leaves.push_back({child});
+    }
+  }
+
+  // At the leaf budget every statistic goes, and the leaves keep only their class weights
+  if(_leaf_count >= _options.max_leaves) {
+    for(const LEAF& learning : _leaves)
+      _nodes[learning.node].leaf = NO_NODE;
+    _leaves.clear();
+    _leaves.shrink_to_fit();
+  }
+}
+
+template<typename T, typename CRITERION>
+QUESTION<T> HOEFFDING_TREE<T, CRITERION>::_question(size_t column, double key) const {
+  if constexpr (std::is_same_v<T, FEATURE>) {
+    if(_schema[column] == FLOAT)
+      return QUESTION<T>(column, FEATURE(key));
+    if(_schema[column] == INT)
+      return QUESTION<T>(column, FEATURE(static_cast<int64_t>(key)));
+  } else if constexpr (std::is_arithmetic_v<T>) {
+    return QUESTION<T>(column, static_cast<T>(key));
+  }
+
+  if constexpr (!std::is_arithmetic_v<T>) {
+    CATEGORY_SET categories;
+    categories.insert(CATEGORY_ID(static_cast<uint32_t>(key)));
+    return QUESTION<T>(column, std::move(categories));
+  }
+}
+
+template<typename T, typename CRITERION>
+template<typename PROFILE>
+TREE<T, PROFILE, CRITERION> HOEFFDING_TREE<T, CRITERION>::to_tree() const {
+  DATASET<T> dataset;
+  dataset.schema = _schema;
+  dataset.classes = _classes;
+  dataset.columns.resize(_schema.size());
+  for(const auto& dictionary : _dictionaries)
+    dataset.dictionaries.push_back(dictionary ? std::make_shared<const DICTIONARY>(*dictionary) : nullptr);
+
+  auto arena = std::make_shared<NODE_ARENA<T>>();
+  size_t classes = _classes.size();
+  arena->classes = _classes;
+  arena->add_nodes(_nodes.size());
+
+  // Children always come after their parent, so a backward pass meets them first
+  for(size_t node = _nodes.size(); node-- > 0;) {
+    const STREAM_NODE& stream_node = _nodes[node];
+    NODE<T>& tree_node = arena->nodes[node];
+    double* counts = arena->counts.data() + node * classes;
+
+    if(stream_node.true_branch == NO_NODE) {
+      std::copy(stream_node.stats.counts.begin(), stream_node.stats.counts.end(), counts); // Missing classes stay 0
+    } else {
+      const QUESTION<T>& question = stream_node.question;
+      if(question.categories().empty())
+        tree_node.question = question;
+      else
+        tree_node.question = QUESTION<T>(question.column(), question.categories(), dataset.dictionaries[question.column()]);
+      tree_node.true_branch = stream_node.true_branch;
+      tree_node.false_branch = stream_node.true_branch + 1;
+      tree_node.branches = 2;
+
+      for(size_t child = tree_node.true_branch; child <= tree_node.false_branch; ++child)
+        for(size_t class_id = 0; class_id < classes; ++class_id)
+          counts[class_id] += arena->counts[child * classes + class_id];
+    }
+
+    CLASS_STATS stats(classes);
+    std::copy(counts, counts + classes, stats.counts.begin());
+    stats.weight = std::accumulate(counts, counts + classes, 0.0);
+    tree_node.weight = stats.weight;
+    tree_node.impurity = stats.weight > 0 ? CRITERION::impurity(stats) : 0.0;
+    tree_node.label = classes ? std::max_element(counts, counts + classes) - counts : 0;
+    for(size_t class_id = 0; stats.weight > 0 && class_id < classes; ++class_id)
+      arena->probabilities[node * classes + class_id] = counts[class_id] / stats.weight;
+  }
+
+  for(NODE<T>& tree_node : arena->nodes) {
+    if(tree_node.is_leaf() || arena->nodes[0].weight <= 0)
+      continue;
+    const NODE<T>& true_node = arena->nodes[tree_node.true_branch];
+    const NODE<T>& false_node = arena->nodes[tree_node.false_branch];
+    tree_node.gain = (tree_node.impurity * tree_node.weight - true_node.impurity * true_node.weight 
+        - false_node.impurity * false_node.weight) / arena->nodes[0].weight;
+  }
+
+  return TREE<T, PROFILE, CRITERION>(std::move(dataset), std::move(arena));
+}
+
+
+// Function Definitions
+template<typename T>
+double gini(const TDATA_COL<T>& r) {
+  return gini(r.count(), r.size());
+}
+
+inline double gini(const CLASS_COUNT& counts, size_t total) {
+  double impurity = 1.0;
+  for(const auto& [_name, amount] : counts) {
+    double correct_label_probability = amount / ((double) total); 
+    impurity -= pow(correct_label_probability, 2.0);
+  }
+
+  return impurity;
+}
+
+inline double gini(std::span<const double> counts, double total) {
+  double impurity = 1.0;
+  for(double amount : counts) {
+    double correct_label_probability = amount / ((double) total); 
+    impurity -= correct_label_probability * correct_label_probability;
+  }
+
+  return impurity;
+}
+
+template<typename V>
+bool missing(const V& feature) {
+  if constexpr (std::is_floating_point_v<V>)
+    return std::isnan(feature);
+  else
+    return false;
+}
+
+inline bool missing(const FEATURE& feature) {
+  const double* value = std::get_if<FLOAT>(&feature);
+  return value && std::isnan(*value);
+}
+
+template<typename V>
+bool value_less(const V& a, const V& b) {
+  if constexpr (std::is_floating_point_v<V>)
+    return a < b || (std::isnan(b) && !std::isnan(a));
+  else
+    return a < b;
+}
+
+template<typename V>
+bool ask(const V& feature, const V& value) {
+  if constexpr (std::is_arithmetic_v<V>)
+    return feature <= value;
+  else
+    return feature == value;
+}
+
+inline bool ask(const FEATURE& feature, const FEATURE& value) {
+  switch(value.index()) {
+    case FLOAT: return ask(std::get<FLOAT>(feature), std::get<FLOAT>(value));
+    case INT: return ask(std::get<INT>(feature), std::get<INT>(value));
+    case CATEGORY: return ask(std::get<CATEGORY>(feature), std::get<CATEGORY>(value));
+    default: return ask(std::get<STRING>(feature), std::get<STRING>(value));
+  }
+}
+
+template<typename V, typename F>
+decltype(auto) visit_column(const std::vector<V>& column, F&& f) {
+  return f(column);
+}
+
+template<typename F>
+decltype(auto) visit_column(const COLUMN& column, F&& f) {
+  return std::visit(std::forward<F>(f), column);
+}
+
+inline std::ostream& operator<<(std::ostream& out, CATEGORY_ID id) {
+  out << '#' << static_cast<uint32_t>(id);
+  return out;
+}
+
+inline std::ostream& operator<<(std::ostream& out, const FEATURE& feature) {
+  std::visit([&](const auto& value) { out << value; }, feature);
+  return out;
+}
+
+template<typename T>
+std::pair<TDATA_COL<T>, TDATA_COL<T>> partition(const TDATA_COL<T>& r, const QUESTION<T>& q) {
+  TDATA_COL<T> true_rows, false_rows;
+
+  for(const auto& x : r) {
+    if(q(x))
+      true_rows.push_back(x);
+    else
+      false_rows.push_back(x);
+  }
+  return {true_rows, false_rows};
+}
+
+template<typename T>
+std::pair<std::vector<size_t>, std::vector<size_t>> partition(const DATASET<T>& dataset, std::span<const size_t> rows, const QUESTION<T>& q) {
+  std::vector<size_t> true_rows(rows.begin(), rows.end()), false_rows;
+  size_t true_size = partition(dataset, std::span<size_t>(true_rows), q, false_rows);
+
+  true_rows.resize(true_size);
+  return {true_rows, false_rows};
+}
+
+template<typename T>
+size_t partition(const DATASET<T>& dataset, std::span<size_t> rows, const QUESTION<T>& q, std::vector<size_t>& scratch, 
+    NODE_ROWS* node_rows) {
+  size_t true_size = 0;
+  scratch.clear();
+
+  // Writes never pass the row being read, so the true rows compact in place
+  auto route = [&](auto&& answer) {
+    for(size_t row : rows) {
+      if(answer(row))
+        rows[true_size++] = row;
+      else
+        scratch.push_back(row);
+    }
+  };
+
+  // Compressed columns: every row answers as zero does, except the entries flagged for answering otherwise
+  if constexpr (std::is_arithmetic_v<T>) {
+    if(dataset.is_sparse(q.column())) {
+      NODE_ROWS own_rows;
+      if(!node_rows) {
+        own_rows.mark(rows, dataset.size());
+        node_rows = &own_rows;
+      }
+
+      std::vector<std::pair<T, size_t>> entries;
+      dataset.sparse_entries(q.column(), rows, *node_rows, entries);
+      bool zero_true = ask(T{}, q.value());
+      size_t flag = node_rows->stamp + 1;
+      for(const auto& [value, row] : entries)
+        if(ask(value, q.value()) != zero_true)
+          node_rows->marks[row] = flag;
+
+      route([&](size_t row) { return zero_true != (node_rows->marks[row] == flag); });
+      std::copy(scratch.begin(), scratch.end(), rows.begin() + true_size);
+      return true_size;
+    }
+  }
+
+  visit_column(dataset.columns[q.column()], [&](const auto& values) {
+    using V = typename std::decay_t<decltype(values)>::value_type;
+
+    if constexpr (std::is_same_v<V, CATEGORY_ID>) {
+      if(!q.categories().empty()) {
+        route([&](size_t row) { return q.categories().contains(values[row]); });
+        return;
+      }
+    }
+
+    if constexpr (std::is_same_v<T, V> || std::is_same_v<T, FEATURE>) {
+      const V* value;
+      if constexpr (std::is_same_v<T, V>)
+        value = &q.value();
+      else
+        value = &std::get<V>(q.value());
+
+      bool missing_true = q.missing_true();
+      route([&](size_t row) { return ask(values[row], *value) | (missing_true & missing(values[row])); });
+    }
+  });
+
+  std::copy(scratch.begin(), scratch.end(), rows.begin() + true_size);
+  return true_size;
+}
+
+template<typename T>
+void partition(const DATASET<T>& dataset, std::span<size_t> rows, const QUESTION<T>& q, std::vector<size_t>& scratch, std::vector<size_t>& sizes) {
+  sizes.assign(q.branches(), 0);
+
+  visit_column(dataset.columns[q.column()], [&](const auto& values) {
+    using V = typename std::decay_t<decltype(values)>::value_type;
+    if constexpr (std::is_same_v<V, CATEGORY_ID>) {
+      for(size_t row : rows)
+        sizes[q.branch(values[row])] += 1;
+
+      // Counting sort: scattering backwards from the end of every child keeps each one in order
+      std::partial_sum(sizes.begin(), sizes.end(), sizes.begin());
+      scratch.assign(rows.begin(), rows.end());
+      for(size_t i = scratch.size(); i-- > 0;)
+        rows[--sizes[q.branch(values[scratch[i]])]] = scratch[i];
+
+      // Every end now sits at the start of its child
+      for(size_t child = 0; child < sizes.size(); ++child)
+        sizes[child] = (child + 1 < sizes.size() ? sizes[child + 1] : rows.size()) - sizes[child];
+    }
+  });
+}
+
+template<typename T>
+double info_gain(const TDATA_COL<T>& left, const TDATA_COL<T>& right, double base_impurity) {
+  int left_size = left.size();
+  double item_ratio = ((double) left_size) / (left_size + right.size());
+
+  return base_impurity - item_ratio * gini(left) - (1 - item_ratio) * gini(right);
+};
+
+inline double gini_gain(
+    const std::vector<double>& total_counts, 
+    const std::vector<double>& true_counts, 
+    double true_weight, 
+    double total_weight, 
+    double root_impurity
+    ) {
+  double false_weight = total_weight - true_weight;
+  double true_squares = 0.0, false_squares = 0.0;
+
+  for(size_t class_id = 0; class_id < true_counts.size(); ++class_id) {
+    double true_amount = true_counts[class_id], false_amount = total_counts[class_id] - true_counts[class_id];
+    true_squares += true_amount * true_amount;
+    false_squares += false_amount * false_amount;
+  }
+
+  return root_impurity 
+    - (true_weight - true_squares / true_weight) / total_weight 
+    - (false_weight - false_squares / false_weight) / total_weight;
+}
+
+template<typename CRITERION, enum MODE M, typename V>
+SPLIT_CANDIDATE<V> split_kernel(
+    const std::vector<V>& values, 
+    const std::vector<typename CRITERION::TARGET>& targets, 
+    const std::vector<double>& weights, 
+    std::span<const size_t> rows, 
+    const typename CRITERION::STATS& total, 
+    double root_impurity, 
+    const TREE_OPTIONS& options,
+    bool presorted
+    ) {
+  using STATS = typename CRITERION::STATS;
+  size_t total_size = rows.size();
+  size_t min_leaf = std::max<size_t>(options.min_samples_leaf, 1);
+  SPLIT_CANDIDATE<V> best;
+
+  // Every candidate is scored from row statistics alone; rows are only partitioned once a split is chosen.
+  // Leaf sizes are counted in rows, and a candidate too small for them is never scored.
+  auto evaluate = [&](size_t true_size, auto&& gain_of) {
+    best.candidates += 1;
+    if(true_size < min_leaf || total_size - true_size < min_leaf)
+      return false;
+
+    double gain = gain_of();
+    if(best.gain < gain) {
+      best.gain = gain;
+      return true;
+    }
+    return false;
+  };
+
+  // Adds the capacity of buffers live at the same time to the footprint of the search
+  auto hold = [&](const auto&... buffers) {
+    ((best.scratch_bytes += buffers.capacity() * sizeof(typename std::decay_t<decltype(buffers)>::value_type)), ...);
+  };
+
+  // Impurity of a side weighted by its share of the rows, so two of them sum to the impurity after a split
+  auto risk = [&](const STATS& side) { return side.weight > 0 ? CRITERION::impurity(side) * side.weight : 0.0; };
+  auto split_gain = [&](double true_risk, double false_risk) { return root_impurity - (true_risk + false_risk) / total.weight; };
+
+  // A feature value with the target and weight of its row
+  struct ENTRY {
+    V value;
+    typename CRITERION::TARGET target;
+    double weight;
+  };
+
+  auto entries = [&]() {
+    std::vector<ENTRY> sorted;
+    sorted.reserve(total_size);
+    for(size_t row : rows)
+      sorted.push_back({values[row], targets[row], weights[row]});
+    return sorted;
+  };
+
+  if constexpr (std::is_arithmetic_v<V>) {
+    // Sweep the sorted column once; every boundary between distinct values is a threshold. Missing values
+    // sort last and are tried on both sides of every threshold, keeping the better default direction.
+    auto sweep = [&](auto entry_at) {
+      size_t present = total_size;
+      while(present > 0 && missing(entry_at(present - 1).value))
+        --present;
+
+      // true_stats with the missing rows joining them, only filled when there are missing rows
+      STATS missing_true_stats(present < total_size ? total.classes() : 0);
+      for(size_t i = present; i < total_size; ++i)
+        missing_true_stats.add(entry_at(i).target, entry_at(i).weight);
+
+      // Without subtraction, the false side of every threshold is known from a sweep in the other direction:
+      // false_risks[i] holds the rows after i with the missing ones, present_false_risks[i] without them
+      std::vector<double> false_risks, present_false_risks;
+      if constexpr (!CRITERION::subtractive) {
+        STATS false_stats = missing_true_stats, present_false_stats(total.classes());
+        false_risks.resize(present);
+        present_false_risks.resize(present);
+
+        for(size_t i = present; i-- > 0;) {
+          false_risks[i] = risk(present < total_size ? false_stats : present_false_stats);
+          present_false_risks[i] = risk(present_false_stats);
+
+          ENTRY entry = entry_at(i);
+          present_false_stats.add(entry.target, entry.weight);
+          if(present < total_size)
+            false_stats.add(entry.target, entry.weight);
+        }
+      }
+
+      STATS true_stats(total.classes());
+      for(size_t i = 0; i < present; ++i) {
+        ENTRY entry = entry_at(i);
+        true_stats.add(entry.target, entry.weight);
+        if(present < total_size)
+          missing_true_stats.add(entry.target, entry.weight);
+
+        // The last present value is a threshold too when missing values are left on the other side
+        bool boundary = i + 1 < present ? entry.value < entry_at(i + 1).value : present < total_size;
+        if(!boundary)
+          continue;
+
+        auto missing_false_gain = [&]() {
+          if constexpr (CRITERION::subtractive)
+            return CRITERION::gain(total, true_stats, root_impurity);
+          else
+            return split_gain(risk(true_stats), false_risks[i]);
+        };
+        if(evaluate(i + 1, missing_false_gain)) {
+          best.value = entry.value;
+          best.missing_true = false;
+        }
+
+        auto missing_true_gain = [&]() {
+          if constexpr (CRITERION::subtractive)
+            return CRITERION::gain(total, missing_true_stats, root_impurity);
+          else
+            return split_gain(risk(missing_true_stats), present_false_risks[i]);
+        };
+        bool missing_true = present < total_size && i + 1 < present
+          && evaluate(i + 1 + total_size - present, missing_true_gain);
+        if(missing_true) {
+          best.value = entry.value;
+          best.missing_true = true;
+        }
+      }
+      hold(false_risks, present_false_risks);
+    };
+
+    if(presorted) {
+      sweep([&](size_t i) { return ENTRY{values[rows[i]], targets[rows[i]], weights[rows[i]]}; });
+      return best;
+    }
+
+    // Missing values move to the tail first, so sorting the rest needs no NaN checks
+    std::vector<ENTRY> sorted = entries();
+    auto present = sorted.end();
+    if constexpr (std::is_floating_point_v<V>)
+      present = std::partition(sorted.begin(), sorted.end(), [](const ENTRY& entry) { return !missing(entry.value); });
+    std::sort(sorted.begin(), present, [](const ENTRY& a, const ENTRY& b) { return a.value < b.value; });
+    sweep([&](size_t i) { return sorted[i]; });
+    hold(sorted);
+  } else {
+    // Statistics of every distinct value present at this node, in value order
+    struct GROUP {
+      V value;
+      STATS stats;
+      size_t size;
+    };
+
+    std::vector<GROUP> groups;
+    if constexpr (std::is_same_v<V, CATEGORY_ID>) {
+      std::vector<ENTRY> sorted = entries();
+      std::sort(sorted.begin(), sorted.end(), [](const ENTRY& a, const ENTRY& b) { return a.value < b.value; });
+
+      for(const auto& [value, target, weight] : sorted) {
+        if(groups.empty() || groups.back().value != value)
+          groups.push_back({value, STATS(total.classes()), 0});
+        groups.back().stats.add(target, weight);
+        groups.back().size += 1;
+      }
+      hold(sorted);
+    } else {
+      std::unordered_map<V, size_t> group_of;
+      for(size_t row : rows) {
+        auto [it, inserted] = group_of.emplace(values[row], groups.size());
+        if(inserted)
+          groups.push_back({values[row], STATS(total.classes()), 0});
+        groups[it->second].stats.add(targets[row], weights[row]);
+        groups[it->second].size += 1;
+      }
+      // One node and one bucket pointer per distinct value
+      best.scratch_bytes += group_of.size() * (sizeof(std::pair<const V, size_t>) + sizeof(void*))
+        + group_of.bucket_count() * sizeof(void*);
+    }
+    hold(groups);
+    best.scratch_bytes += groups.size() * total.classes() * sizeof(double);
+
+    if(groups.size() < 2)
+      return best;
+
+    // Gain of sending the given groups to the true side and every other group to the false side
+    std::vector<uint8_t> chosen;
+    auto rest_risk = [&](std::span<const size_t> true_groups) {
+      chosen.assign(groups.size(), 0);
+      for(size_t g : true_groups)
+        chosen[g] = 1;
+
+      STATS false_stats(total.classes());
+      for(size_t g = 0; g < groups.size(); ++g)
+        if(!chosen[g])
+          false_stats.add(groups[g].stats);
+      return risk(false_stats);
+    };
+
+    if constexpr (!std::is_same_v<V, CATEGORY_ID>) {
+      // One candidate per distinct value, asked against the rest
+      for(size_t g = 0; g < groups.size(); ++g) {
+        auto gain_of = [&]() {
+          if constexpr (CRITERION::subtractive)
+            return CRITERION::gain(total, groups[g].stats, root_impurity);
+          else
+            return split_gain(risk(groups[g].stats), rest_risk(std::span<const size_t>(&g, 1)));
+        };
+        if(evaluate(groups[g].size, gain_of))
+          best.value = groups[g].value;
+      }
+      hold(chosen);
+      return best;
+    } else {
+      // Sorting categories by the share of one class and trying every prefix finds the optimal subset
+      // for two classes (Breiman); sorting by mean target does the same for variance. With more classes,
+      // the most frequent ones each give such an ordering.
+      std::vector<size_t> order(groups.size()), best_order;
+      std::iota(order.begin(), order.end(), 0);
+      size_t best_prefix = 0;
+      std::vector<double> false_risks;
+
+      // Every prefix of the current order is one subset of categories
+      auto sweep = [&]() {
+        if constexpr (!CRITERION::subtractive) {
+          STATS false_stats(total.classes());
+          false_risks.resize(order.size());
+          for(size_t prefix = order.size(); prefix-- > 0;) {
+            false_risks[prefix] = risk(false_stats);
+            false_stats.add(groups[order[prefix]].stats);
+          }
+        }
+
+        STATS true_stats(total.classes());
+        size_t true_size = 0;
+        for(size_t prefix = 1; prefix < order.size(); ++prefix) {
+          const GROUP& group = groups[order[prefix - 1]];
+          true_stats.add(group.stats);
+          true_size += group.size;
+
+          auto gain_of = [&]() {
+            if constexpr (CRITERION::subtractive)
+              return CRITERION::gain(total, true_stats, root_impurity);
+            else
+              return split_gain(risk(true_stats), false_risks[prefix - 1]);
+          };
+          if(evaluate(true_size, gain_of)) {
+            best_order = order;
+            best_prefix = prefix;
+          }
+        }
+      };
+
+      size_t orderings = 1;
+      if constexpr (CRITERION::classification) {
+        std::vector<size_t> ordering_classes;
+        for(size_t class_id = 0; class_id < total.classes(); ++class_id)
+          if(total.counts[class_id] > 0)
+            ordering_classes.push_back(class_id);
+
+        std::sort(ordering_classes.begin(), ordering_classes.end(), [&](size_t a, size_t b) {
+          return total.counts[a] > total.counts[b];
+        });
+
+        orderings = ordering_classes.size() <= 2 ? 1 : std::min(options.max_category_orderings, ordering_classes.size());
+        for(size_t o = 0; o < orderings; ++o) {
+          size_t class_id = ordering_classes[o];
+          std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return groups[a].stats.counts[class_id] * groups[b].stats.weight < groups[b].stats.counts[class_id] * groups[a].stats.weight;
+          });
+          sweep();
+        }
+      } else {
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+          return CRITERION::value(groups[a].stats) < CRITERION::value(groups[b].stats);
+        });
+        sweep();
+      }
+
+      // Single categories against the rest, so multiclass search never does worse than equality questions
+      if(orderings > 1) {
+        for(size_t g = 0; g < groups.size(); ++g) {
+          auto gain_of = [&]() {
+            if constexpr (CRITERION::subtractive)
+              return CRITERION::gain(total, groups[g].stats, root_impurity);
+            else
+              return split_gain(risk(groups[g].stats), rest_risk(std::span<const size_t>(&g, 1)));
+          };
+          if(evaluate(groups[g].size, gain_of)) {
+            best_order = {g};
+            best_prefix = 1;
+          }
+        }
+      }
+
+      for(size_t prefix = 0; prefix < best_prefix; ++prefix)
+        best.categories.insert(groups[best_order[prefix]].value);
+      hold(order, best_order, false_risks, chosen);
+
+      // One child per category, kept when it beats the best subset. Groups are in id order, so the
+      // table is filled in one pass; ids absent from the node join the heaviest child.
+      if constexpr (M == MULTIPLE) {
+        if(groups.size() <= 2 || groups.size() > options.max_branches)
+          return best;
+
+        best.candidates += 1;
+        double children_risk = 0.0;
+        size_t heaviest = 0;
+        for(size_t g = 0; g < groups.size(); ++g) {
+          if(groups[g].size < min_leaf)
+            return best;
+          children_risk += risk(groups[g].stats);
+          if(groups[heaviest].stats.weight < groups[g].stats.weight)
+            heaviest = g;
+        }
+
+        double gain = root_impurity - children_risk / total.weight;
+        if(gain <= best.gain)
+          return best;
+
+        best.gain = gain;
+        best.categories = CATEGORY_SET();
+        best.branches.assign(static_cast<size_t>(groups.back().value) + 2, heaviest);
+        for(size_t g = 0; g < groups.size(); ++g)
+          best.branches[static_cast<size_t>(groups[g].value)] = g;
+      }
+    }
+  }
+
+  return best;
+}
+
+inline void parallel_for(size_t items, size_t threads, const std::function<void(size_t begin, size_t end)>& body) {
+  if(threads == 0)
+    threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  threads = std::min(threads, items);
+  if(threads <= 1) {
+    body(0, items);
+    return;
+  }
+
+  // The calling thread takes the first block
+  std::vector<std::thread> workers;
+  size_t block = (items + threads - 1) / threads;
+  for(size_t begin = block; begin < items; begin += block)
+    workers.emplace_back(body, begin, std::min(begin + block, items));
+  body(0, std::min(block, items));
+  for(std::thread& worker : workers)
+    worker.join();
+}
+
+inline void shap_extend(SHAP_PATH_ELEMENT* path, size_t depth, double zero_fraction, double one_fraction, size_t column) {
+  path[depth] = {column, zero_fraction, one_fraction, depth == 0 ? 1.0 : 0.0};
+  for(size_t i = depth; i-- > 0;) {
+    path[i + 1].weight += one_fraction * path[i].weight * (i + 1) / (depth + 1);
+    path[i].weight = zero_fraction * path[i].weight * (depth - i) / (depth + 1);
+  }
+}
+
+inline void shap_unwind(SHAP_PATH_ELEMENT* path, size_t depth, size_t index) {
+  double one_fraction = path[index].one_fraction, zero_fraction = path[index].zero_fraction;
+  double next_one_portion = path[depth].weight;
+
+  for(size_t i = depth; i-- > 0;) {
+    if(one_fraction != 0) {
+      double weight = path[i].weight;
+      path[i].weight = next_one_portion * (depth + 1) / ((i + 1) * one_fraction);
+      next_one_portion = weight - path[i].weight * zero_fraction * (depth - i) / (depth + 1);
+    } else {
+      path[i].weight = path[i].weight * (depth + 1) / (zero_fraction * (depth - i));
+    }
+  }
+
+  for(size_t i = index; i < depth; ++i) {
+    path[i].column = path[i + 1].column;
+    path[i].zero_fraction = path[i + 1].zero_fraction;
+    path[i].one_fraction = path[i + 1].one_fraction;
+  }
+}
+
+inline double shap_unwound_sum(const SHAP_PATH_ELEMENT* path, size_t depth, size_t index) {
+  double one_fraction = path[index].one_fraction, zero_fraction = path[index].zero_fraction;
+  double next_one_portion = path[depth].weight, total = 0.0;
+
+  if(one_fraction != 0) {
+    for(size_t i = depth; i-- > 0;) {
+      double portion = next_one_portion / ((i + 1) * one_fraction);
+      total += portion;
+      next_one_portion = path[i].weight - portion * zero_fraction * (depth - i);
+    }
+  } else if(zero_fraction != 0) {
+    for(size_t i = depth; i-- > 0;)
+      total += path[i].weight / (zero_fraction * (depth - i));
+  }
+
+  return total * (depth + 1);
+}
+
+template<typename T, typename PROFILE, typename CRITERION, typename V, size_t EXTENT>
+void shap_values(const std::vector<TREE<T, PROFILE, CRITERION>>& trees, std::span<const V, EXTENT> row, std::span<double> contributions) {
+  std::fill(contributions.begin(), contributions.end(), 0.0);
+  std::vector<double> tree_contributions(contributions.size());
+  for(const auto& tree : trees) {
+    tree.shap_values(row, std::span<double>(tree_contributions));
+    for(size_t i = 0; i < contributions.size(); ++i)
+      contributions[i] += tree_contributions[i] / trees.size();
+  }
+}
+
+template<typename T, typename PROFILE, typename CRITERION>
+void shap_values(const std::vector<TREE<T, PROFILE, CRITERION>>& trees, const TDATA_COL<T>& data, 
+    std::span<double> contributions, size_t threads) {
+  std::fill(contributions.begin(), contributions.end(), 0.0);
+  std::vector<double> tree_contributions(contributions.size());
+  for(const auto& tree : trees) {
+    tree.shap_values(data, tree_contributions, threads);
+    for(size_t i = 0; i < contributions.size(); ++i)
+      contributions[i] += tree_contributions[i] / trees.size();
+  }
+}
+
+inline void sample_in_place(std::vector<size_t>& items, size_t amount, std::mt19937_64& engine) {
+  if(amount >= items.size())
+    return;
+
+  // Partial Fisher-Yates: the first amount items end up a uniform sample
+  for(size_t i = 0; i < amount; ++i) {
+    std::uniform_int_distribution<size_t> pick(i, items.size() - 1);
+    std::swap(items[i], items[pick(engine)]);
+  }
+  items.resize(amount);
+  std::sort(items.begin(), items.end());
+}
+
+inline size_t sample_size(size_t items, double fraction) {
+  return items ? std::clamp<size_t>(std::llround(fraction * items), 1, items) : 0;
+}
+
+inline std::vector<double> bootstrap_weights(size_t rows, uint64_t seed) {
+  std::vector<double> weights(rows, 0.0);
+  std::mt19937_64 engine(seed);
+  std::uniform_int_distribution<size_t> pick(0, rows ? rows - 1 : 0);
+
+  for(size_t draw = 0; draw < rows; ++draw)
+    weights[pick(engine)] += 1.0;
+  return weights;
+}
+
+inline std::vector<double> goss_weights(std::span<const double> gradients, double top_rate, double other_rate, uint64_t seed) {
+  size_t rows = gradients.size();
+  std::vector<double> weights(rows, 0.0);
+  std::vector<size_t> order(rows);
+  std::iota(order.begin(), order.end(), 0);
+
+  // Ties go to the smaller row, so equal gradients select equal rows on every platform
+  size_t top = std::min<size_t>(std::llround(top_rate * rows), rows);
+  std::nth_element(order.begin(), order.begin() + top, order.end(), [&](size_t a, size_t b) {
+    double magnitude_a = std::abs(gradients[a]), magnitude_b = std::abs(gradients[b]);
+    return magnitude_a != magnitude_b ? magnitude_a > magnitude_b : a < b;
+  });
+
+  for(size_t i = 0; i < top; ++i)
+    weights[order[i]] = 1.0;
+
+  std::vector<size_t> rest(order.begin() + top, order.end());
+  std::sort(rest.begin(), rest.end());
+  size_t others = std::min<size_t>(std::llround(other_rate * rows), rest.size());
+  if(others == 0)
+    return weights;
+
+  std::mt19937_64 engine(seed);
+  double amplification = (double) rest.size() / others;
+  sample_in_place(rest, others, engine);
+  for(size_t row : rest)
+    weights[row] = amplification;
+
+  return weights;
+}
+
+template<typename CRITERION, typename V>
+bool zero_aware_sweep(
+    std::span<const std::pair<V, size_t>> entries, 
+    const std::vector<typename CRITERION::TARGET>& targets, 
+    const std::vector<double>& weights, 
+    size_t total_size, 
+    const typename CRITERION::STATS& total, 
+    double root_impurity, 
+    const TREE_OPTIONS& options,
+    SPLIT_CANDIDATE<V>& best
+    ) {
+  static_assert(CRITERION::subtractive, "Zero rows are the node minus the entries, found by subtraction");
+  using STATS = typename CRITERION::STATS;
+  size_t min_leaf = std::max<size_t>(options.min_samples_leaf, 1);
+  bool improved = false;
+
+  // The zero rows are everything the entries leave of the node
+  STATS zero_stats = total, nonzero_stats(total.classes());
+  for(const auto& [value, row] : entries)
+    nonzero_stats.add(targets[row], weights[row]);
+  zero_stats.subtract(nonzero_stats);
+  size_t zero_size = total_size - entries.size();
+
+  STATS true_stats(total.classes());
+  size_t true_size = 0;
+
+  auto boundary = [&](V value) {
+    if(true_size == total_size)
+      return;
+
+    best.candidates += 1;
+    if(true_size < min_leaf || total_size - true_size < min_leaf)
+      return;
+
+    double gain = CRITERION::gain(total, true_stats, root_impurity);
+    if(best.gain < gain) {
+      best.gain = gain;
+      best.value = value;
+      improved = true;
+    }
+  };
+
+  auto sweep = [&](size_t from, size_t to) {
+    for(size_t e = from; e < to; ++e) {
+      true_stats.add(targets[entries[e].second], weights[entries[e].second]);
+      true_size += 1;
+
+      if(e + 1 == to || entries[e].first < entries[e + 1].first)
+        boundary(entries[e].first);
+    }
+  };
+
+  // Negative values, then the zero rows as one value, then positive values
+  size_t positive = 0;
+  while(positive < entries.size() && entries[positive].first < V{})
+    ++positive;
+
+  sweep(0, positive);
+  if(zero_size > 0) {
+    true_stats.add(zero_stats);
+    true_size += zero_size;
+    boundary(V{});
+  }
+  sweep(positive, entries.size());
+
+  return improved;
+}
+
+template<typename CRITERION, typename V>
+std::pair<size_t, SPLIT_CANDIDATE<V>> bundle_kernel(
+    const FEATURE_BUNDLE& bundle, 
+    const std::vector<const std::vector<V>*>& column_values, 
+    const std::vector<typename CRITERION::TARGET>& targets, 
+    const std::vector<double>& weights, 
+    std::span<const size_t> rows, 
+    const typename CRITERION::STATS& total, 
+    double root_impurity, 
+    const TREE_OPTIONS& options,
+    std::span<const uint8_t> searchable
+    ) {
+  static_assert(CRITERION::subtractive, "Bundles derive the zero rows of a column by subtraction");
+  size_t best_column = NO_BUNDLE;
+  SPLIT_CANDIDATE<V> best;
+
+  // Nonzero rows of the node, grouped by column and sorted by value through their codes
+  std::vector<std::pair<uint32_t, size_t>> nonzero;
+  for(size_t row : rows)
+    if(bundle.codes[row] != 0)
+      nonzero.emplace_back(bundle.codes[row], row);
+  std::sort(nonzero.begin(), nonzero.end());
+
+  std::vector<std::pair<V, size_t>> entries;
+  size_t begin = 0;
+  for(size_t i = 0; i < bundle.columns.size(); ++i) {
+    size_t end = begin;
+    while(end < nonzero.size() && nonzero[end].first < bundle.offsets[i + 1])
+      ++end;
+
+    size_t column_idx = bundle.columns[i];
+    if(searchable.empty() || searchable[column_idx]) {
+      const std::vector<V>& values = *column_values[i];
+      entries.clear();
+      for(size_t e = begin; e < end; ++e)
+        entries.emplace_back(values[nonzero[e].second], nonzero[e].second);
+
+      if(zero_aware_sweep<CRITERION, V>(entries, targets, weights, rows.size(), total, root_impurity, options, best))
+        best_column = column_idx;
+    }
+
+    begin = end;
+  }
+
+  best.scratch_bytes = nonzero.capacity() * sizeof(nonzero[0]) + entries.capacity() * sizeof(entries[0]);
+  return {best_column, best};
+}
+
+template<typename T, enum MODE M, typename CRITERION>
+std::pair<double, QUESTION<T>> find_best_split(const TDATA_COL<T>& tdatacol, const TREE_OPTIONS& options) {
+  DATASET<T> dataset(tdatacol);
+  std::vector<size_t> rows(dataset.size());
+  std::iota(rows.begin(), rows.end(), 0);
+
+  return find_best_split<T, M, CRITERION>(dataset, rows, options);
+}
+
+template<typename T, enum MODE M, typename CRITERION>
+std::pair<double, QUESTION<T>> find_best_split(
+    const DATASET<T>& dataset, 
+    std::span<const size_t> rows, 
+    const TREE_OPTIONS& options, 
+    TRAIN_STATS* stats,
+    std::span<const std::span<const size_t>> sorted_rows,
+    std::span<const size_t> columns,
+    const NODE_ROWS* node_rows
+    ) {
+  static_assert(SPLIT_CRITERION<CRITERION>, "find_best_split needs a CRITERION meeting SPLIT_CRITERION");
+  double best_gain = 0.0;
+  typename CRITERION::STATS total = dataset.template stats<CRITERION>(rows);
+  double root_impurity = CRITERION::impurity(total);
+  const auto& targets = dataset.template row_targets<CRITERION>();
+  bool use_bundles = CRITERION::subtractive && !dataset.bundles.empty();
+
+  QUESTION<T> best_question; 
+
+  // Compressed columns keep their entries of the node, sorted by value, in entries
+  NODE_ROWS own_rows;
+  std::vector<std::pair<T, size_t>> entries;
+  auto search_sparse = [&](size_t column_idx) {
+    if constexpr (std::is_arithmetic_v<T>) {
+      if constexpr (!CRITERION::subtractive) {
+        throw std::invalid_argument("find_best_split: compressed columns need a subtractive criterion");
+      } else {
+        if(!node_rows) {
+          own_rows.mark(rows, dataset.size());
+          node_rows = &own_rows;
+        }
+        dataset.sparse_entries(column_idx, rows, *node_rows, entries);
+        std::sort(entries.begin(), entries.end());
+
+        SPLIT_CANDIDATE<T> candidate;
+        zero_aware_sweep<CRITERION, T>(entries, targets, dataset.weights, rows.size(), total, root_impurity, options, candidate);
+        if(stats) {
+          stats->candidates += candidate.candidates;
+          stats->peak_node_bytes = std::max(stats->peak_node_bytes, entries.capacity() * sizeof(entries[0]));
+        }
+
+        if(candidate.gain > best_gain) {
+          best_gain = candidate.gain;
+          best_question = QUESTION<T>(column_idx, candidate.value);
+        }
+      }
+    }
+  };
+
+  // Columns dispatch on their storage type once; the kernels loop over plain typed vectors
+  size_t searched = columns.empty() ? dataset.col_size() : columns.size();
+  for(size_t i = 0; i < searched; ++i) {
+    size_t column_idx = columns.empty() ? i : columns[i];
+    if(use_bundles && dataset.bundled(column_idx))
+      continue;
+    if(dataset.is_sparse(column_idx)) {
+      search_sparse(column_idx);
+      continue;
+    }
+
+    visit_column(dataset.columns[column_idx], [&](const auto& values) {
+      bool presorted = column_idx < sorted_rows.size() && !sorted_rows[column_idx].empty();
+      auto candidate = presorted
+        ? split_kernel<CRITERION, M>(values, targets, dataset.weights, sorted_rows[column_idx], total, root_impurity, options, true)
+        : split_kernel<CRITERION, M>(values, targets, dataset.weights, rows, total, root_impurity, options);
+      if(stats) {
+        stats->candidates += candidate.candidates;
+        stats->peak_node_bytes = std::max(stats->peak_node_bytes, candidate.scratch_bytes);
+      }
+
+      if(candidate.gain <= best_gain)
+        return;
+
+      best_gain = candidate.gain;
+      if(!candidate.branches.empty())
+        best_question = QUESTION<T>(column_idx, std::move(candidate.branches), dataset.dictionaries[column_idx]);
+      else if(!candidate.categories.empty())
+        best_question = QUESTION<T>(column_idx, std::move(candidate.categories), dataset.dictionaries[column_idx]);
+      else if constexpr (std::is_constructible_v<T, decltype(candidate.value)>)
+        best_question = QUESTION<T>(column_idx, T(candidate.value), candidate.missing_true);
+    });
+  }
+
+  if(!use_bundles)
+    return {best_gain, best_question};
+
+  std::vector<uint8_t> searchable;
+  if(!columns.empty()) {
+    searchable.assign(dataset.col_size(), 0);
+    for(size_t column_idx : columns)
+      searchable[column_idx] = 1;
+  }
+
+  // Bundles hold columns of one storage type, reached through their first column
+  for(const FEATURE_BUNDLE& bundle : dataset.bundles) {
+    visit_column(dataset.columns[bundle.columns.front()], [&](const auto& first) {
+      using V = typename std::decay_t<decltype(first)>::value_type;
+      if constexpr (std::is_arithmetic_v<V> && CRITERION::subtractive) {
+        std::vector<const std::vector<V>*> column_values;
+        for(size_t column_idx : bundle.columns) {
+          if constexpr (std::is_same_v<T, FEATURE>)
+            column_values.push_back(&std::get<std::vector<V>>(dataset.columns[column_idx]));
+          else
+            column_values.push_back(&dataset.columns[column_idx]);
+        }
+
+        auto [column_idx, candidate] = bundle_kernel<CRITERION>(
+            bundle, column_values, targets, dataset.weights, rows, total, root_impurity, options, searchable
+            );
+        if(stats) {
+          stats->candidates += candidate.candidates;
+          stats->peak_node_bytes = std::max(stats->peak_node_bytes, candidate.scratch_bytes);
+        }
+
+        if(candidate.gain <= best_gain)
+          return;
+
+        best_gain = candidate.gain;
+        if constexpr (std::is_constructible_v<T, V>)
+          best_question = QUESTION<T>(column_idx, T(candidate.value));
+      }
+    });
   }
 
   return {best_gain, best_question};
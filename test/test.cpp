@@ -1,6 +1,8 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 #include "GML.hpp"
+#include <thread>
+#include <set>
 
 using namespace std::literals::string_literals;
 
@@ -78,3 +80,1399 @@ TEST_CASE("Testing TREE Implementation") {
     CHECK(tree1.empty());
   }
 }
+
+TEST_CASE("Testing TREE_OPTIONS stopping criteria") {
+  GML::TREE<std::string> full_tree(training_data);
+  REQUIRE(full_tree.node_count() > 1);
+  REQUIRE(!full_tree.dump_tree().is_leaf());
+
+  SUBCASE("max_depth of zero keeps only the root") {
+    GML::TREE<std::string> tree(training_data, {.max_depth = 0});
+    CHECK(tree.dump_tree().is_leaf());
+    CHECK(tree.node_count() == 1);
+  }
+
+  SUBCASE("max_depth bounds every branch") {
+    GML::TREE<std::string> tree(training_data, {.max_depth = 1});
+    auto root = tree.dump_tree();
+    CHECK(root.true_branch().is_leaf());
+    CHECK(root.false_branch().is_leaf());
+    CHECK(tree.node_count() == 3);
+  }
+
+  SUBCASE("min_samples_split and min_samples_leaf") {
+    GML::TREE<std::string> tree1(training_data, {.min_samples_split = 6});
+    CHECK(tree1.dump_tree().is_leaf());
+
+    GML::TREE<std::string> tree2(training_data, {.min_samples_leaf = 3});
+    CHECK(tree2.dump_tree().is_leaf()); // 5 rows cannot give two leaves of 3
+  }
+
+  SUBCASE("min_impurity_decrease and max_nodes") {
+    GML::TREE<std::string> tree1(training_data, {.min_impurity_decrease = 1.0});
+    CHECK(tree1.dump_tree().is_leaf());
+
+    GML::TREE<std::string> tree2(training_data, {.max_nodes = 2});
+    CHECK(tree2.node_count() == 1);
+
+    GML::TREE<std::string> tree3(training_data, {.max_nodes = 3});
+    CHECK(tree3.node_count() <= 3);
+  }
+}
+
+TEST_CASE("Testing TREE cost-complexity pruning") {
+  GML::TREE<std::string> tree(training_data);
+  // Training fills the root's collapse point, so const readers never write to the nodes copies share
+  CHECK(tree.dump_tree().nodedata().prune_alpha < std::numeric_limits<double>::infinity());
+  const GML::PRUNING_PATH& path = tree.pruning_path();
+
+  REQUIRE(!path.empty());
+  REQUIRE(path.alphas.size() == path.impurities.size());
+  REQUIRE(path.alphas.size() == path.leaves.size());
+  CHECK(path.alphas.front() == 0.0);
+  CHECK(path.leaves.front() == (tree.node_count() + 1) / 2);
+  CHECK(path.leaves.back() == 1);
+  CHECK(path.impurities.back() == doctest::Approx(GML::gini(training_data)));
+
+  for(size_t i = 1; i < path.alphas.size(); ++i) {
+    CHECK(path.alphas[i - 1] < path.alphas[i]);
+    CHECK(path.leaves[i - 1] > path.leaves[i]);
+    CHECK(path.impurities[i - 1] <= path.impurities[i]);
+  }
+
+  SUBCASE("Pruning at zero keeps the trained tree") {
+    size_t before = tree.node_count();
+    tree.prune(0.0);
+    CHECK(tree.node_count() == before);
+  }
+
+  SUBCASE("Pruning at the last alpha leaves only the root") {
+    double last_alpha = path.alphas.back();
+    GML::TREE<std::string> pruned(tree);
+    pruned.prune(last_alpha);
+
+    CHECK(pruned.dump_tree().is_leaf());
+    CHECK(pruned.node_count() == 1);
+    CHECK(pruned.pruning_path().alphas.size() == 1);
+    CHECK(!tree.dump_tree().is_leaf()); // Copies do not share the pruned nodes
+  }
+
+  SUBCASE("Pruning between alphas matches the cached path") {
+    for(size_t i = 0; i < path.alphas.size(); ++i) {
+      GML::TREE<std::string> pruned(tree);
+      pruned.prune(path.alphas[i]);
+      CHECK(pruned.node_count() == 2 * path.leaves[i] - 1);
+      CHECK(pruned.pruning_path().leaves.front() == path.leaves[i]);
+      CHECK(pruned.pruning_path().impurities.front() == doctest::Approx(path.impurities[i]));
+    }
+  }
+}
+
+TEST_CASE("Testing threshold questions on arithmetic features") {
+  GML::TDATA_COL<double> numeric_data;
+  for(int i = 1; i <= 10; ++i)
+    numeric_data.push_back({i <= 4 ? "Low"s : "High"s, {(double) i, (double) (i % 3)}});
+
+  GML::TREE<double> tree(numeric_data);
+  auto root = tree.dump_tree();
+
+  // One threshold separates both classes where equality questions would need a chain of nodes
+  REQUIRE(!root.is_leaf());
+  CHECK(tree.node_count() == 3);
+  CHECK(root.question().column() == 0);
+  CHECK(root.question().value() == 4.0);
+  CHECK(root.question()(GML::DATA<double>({4.0, 0.0})));
+  CHECK(!root.question()(GML::DATA<double>({4.5, 0.0})));
+
+  CHECK(tree.predict(GML::DATA<double>({2.5, 1.0})).nodedata().count()["Low"] == 4);
+  CHECK(tree.predict(GML::DATA<double>({7.5, 1.0})).nodedata().count()["High"] == 6);
+
+  auto [gain, question] = GML::find_best_split(numeric_data);
+  auto [true_rows, false_rows] = GML::partition(numeric_data, question);
+  CHECK(gain == doctest::Approx(GML::gini(numeric_data)));
+  CHECK(true_rows.size() == 4);
+  CHECK(false_rows.size() == 6);
+}
+
+TEST_CASE("Testing mixed-type rows") {
+  GML::TDATA_COL<GML::FEATURE> mixed_data({
+      {"Apple"s, {3.0, "Green"s, int64_t{1}}},
+      {"Apple"s, {3.5, "Red"s, int64_t{2}}},
+      {"Grape"s, {1.0, "Red"s, int64_t{40}}},
+      {"Grape"s, {1.2, "Green"s, int64_t{35}}},
+      {"Lemon"s, {3.2, "Yellow"s, int64_t{1}}}
+      });
+
+  GML::DATASET<GML::FEATURE> dataset(mixed_data);
+  REQUIRE(dataset.schema == GML::SCHEMA({GML::FLOAT, GML::STRING, GML::INT}));
+  CHECK(std::holds_alternative<std::vector<double>>(dataset.columns[0]));
+  CHECK(std::holds_alternative<std::vector<GML::CATEGORY_ID>>(dataset.columns[1])); // Strings are stored encoded
+  CHECK(dataset.dictionaries[1]->size() == 3);
+  CHECK(!dataset.dictionaries[0]);
+  CHECK(std::holds_alternative<std::vector<int64_t>>(dataset.columns[2]));
+  CHECK(dataset.classes.size() == 3);
+  CHECK(dataset.count(std::vector<size_t>{0, 1, 2, 3, 4}) == std::vector<double>({2, 2, 1}));
+
+  GML::TREE<GML::FEATURE> tree(mixed_data);
+  auto root = tree.dump_tree();
+  REQUIRE(!root.is_leaf());
+
+  auto predict_count = [&](std::vector<GML::FEATURE> row, const std::string& label) {
+    return tree.predict(row).nodedata().count()[label];
+  };
+
+  CHECK(predict_count({1.1, "Red"s, int64_t{38}}, "Grape") == 2);
+  CHECK(predict_count({3.3, "Yellow"s, int64_t{1}}, "Lemon") == 1);
+  CHECK(predict_count({3.1, "Green"s, int64_t{1}}, "Apple") == 2);
+
+  SUBCASE("Questions keep the type of their column") {
+    GML::QUESTION<GML::FEATURE> threshold(0, 2.0);
+    GML::QUESTION<GML::FEATURE> equality(1, "Red"s);
+    CHECK(threshold.ordered());
+    CHECK(!equality.ordered());
+    CHECK(threshold(mixed_data[2]));
+    CHECK(!threshold(mixed_data[0]));
+    CHECK(equality(mixed_data[1]));
+    CHECK(!equality(mixed_data[0]));
+  }
+
+  SUBCASE("Rows that disagree with the schema are rejected") {
+    auto bad_data = mixed_data;
+    bad_data.push_back({"Grape"s, {"Small"s, "Red"s, int64_t{30}}});
+    CHECK_THROWS_AS(GML::DATASET<GML::FEATURE>{bad_data}, std::bad_variant_access);
+  }
+}
+
+TEST_CASE("Testing categorical subset questions") {
+  GML::TDATA_COL<std::string> color_data;
+  for(const auto& [color, label] : {std::pair{"Red"s, "Sweet"s}, {"Blue"s, "Sour"s}, {"Yellow"s, "Sweet"s}, {"Green"s, "Sour"s}}) {
+    color_data.push_back({label, {color}});
+    color_data.push_back({label, {color}});
+  }
+
+  GML::DATASET<std::string> dataset(color_data);
+  REQUIRE(dataset.dictionaries[0]->size() == 4);
+  CHECK(dataset.encode(GML::DATA<std::string>({"Yellow"s}))[0] == dataset.dictionaries[0]->find("Yellow"));
+  CHECK(dataset.encode(GML::DATA<std::string>({"Purple"s}))[0] == GML::UNKNOWN_CATEGORY);
+
+  // Both classes are separated by one membership question instead of a chain of equality questions
+  GML::TREE<std::string> tree(color_data);
+  const auto& question = tree.dump_tree().question();
+  CHECK(tree.node_count() == 3);
+  CHECK(question.categories().size() == 2);
+  CHECK(question(color_data[0]) == question(color_data[4]));
+  CHECK(question(color_data[0]) != question(color_data[2]));
+
+  CHECK(tree.predict(GML::DATA<std::string>({"Red"s})).nodedata().count()["Sweet"] == 4);
+  CHECK(tree.predict(GML::DATA<std::string>({"Green"s})).nodedata().count()["Sour"] == 4);
+  CHECK(!tree.predict(GML::DATA<std::string>({"Purple"s})).nodedata().empty()); // Unseen categories still reach a leaf
+
+  SUBCASE("Multiclass targets use the bounded ordering heuristic") {
+    GML::TDATA_COL<std::string> multi_data;
+    const std::string colors[] = {"Red"s, "Blue"s, "Yellow"s, "Green"s, "Black"s, "White"s};
+    for(size_t i = 0; i < 6; ++i)
+      for(size_t repeat = 0; repeat < 3; ++repeat)
+        multi_data.push_back({i < 2 ? "A"s : i < 4 ? "B"s : "C"s, {colors[i]}});
+
+    GML::TREE<std::string> multi_tree(multi_data);
+    CHECK(multi_tree.node_count() == 5);
+    for(const auto& tdata : multi_data)
+      CHECK(multi_tree.predict(tdata).nodedata().count()[tdata.label] == 6);
+  }
+}
+
+TEST_CASE("Testing TREE training instrumentation") {
+  GML::TREE<std::string, GML::TRAIN_PROFILE> profiled(training_data);
+  GML::TREE<std::string> plain(training_data);
+  const GML::TRAIN_STATS& stats = profiled.train_stats();
+
+  // Profiling observes training without changing the tree it builds
+  CHECK(profiled.node_count() == plain.node_count());
+  CHECK(stats.nodes == profiled.node_count());
+  CHECK(stats.candidates > 0);
+  CHECK(stats.rows_copied >= training_data.size());
+  CHECK(stats.peak_node_bytes > 0);
+  // At least the entries sorted at the root, each wider than a row index
+  CHECK(stats.peak_node_bytes >= training_data.size() * sizeof(size_t));
+  CHECK(stats.split_search_ns > 0);
+  CHECK(stats.impurity_ns > 0);
+  CHECK(stats.partition_ns > 0);
+
+  GML::TRAIN_STATS counted;
+  GML::DATASET<std::string> dataset(training_data);
+  GML::find_best_split(dataset, std::vector<size_t>{0, 1, 2, 3, 4}, GML::TREE_OPTIONS(), &counted);
+  CHECK(counted.candidates > 0);
+}
+
+TEST_CASE("Testing TREE inference instrumentation") {
+  GML::TREE<std::string, GML::PREDICT_PROFILE> tree(training_data);
+
+  for(const auto& tdata : training_data)
+    tree.predict(tdata);
+
+  // Workers exit before the snapshot, which still counts their predictions
+  for(int worker = 0; worker < 2; ++worker) {
+    std::thread([&] {
+      for(const auto& tdata : training_data)
+        tree.predict(tdata);
+    }).join();
+  }
+
+  GML::PREDICT_STATS stats = tree.predict_stats();
+  CHECK(stats.predictions == 3 * training_data.size());
+  CHECK(stats.mean_depth() > 0.0);
+  CHECK(stats.node_visits.size() == tree.node_count());
+  CHECK(stats.node_visits[tree.dump_tree().id()] == stats.predictions); // Every prediction passes the root
+  CHECK(stats.latency_percentile(0.99) > 0);
+
+  uint64_t depth_total = 0, latency_total = 0;
+  for(size_t depth = 0; depth < stats.depth_histogram.size(); ++depth) {
+    depth_total += stats.depth_histogram[depth];
+    latency_total += stats.latency_histogram[depth];
+  }
+  CHECK(depth_total == stats.predictions);
+  CHECK(latency_total == stats.predictions);
+
+  // Leaves reached by predictions add up to the prediction count
+  uint64_t leaf_visits = 0;
+  std::vector<GML::DECISION_NODE<std::string>> pending{tree.dump_tree()};
+  while(!pending.empty()) {
+    auto node = pending.back();
+    pending.pop_back();
+    if(node.is_leaf()) {
+      leaf_visits += stats.node_visits[node.id()];
+    } else {
+      pending.push_back(node.true_branch());
+      pending.push_back(node.false_branch());
+    }
+  }
+  CHECK(leaf_visits == stats.predictions);
+
+  // A thread switching between trees counts into each tree's own registry
+  {
+    GML::TREE<std::string, GML::PREDICT_PROFILE> retrained(training_data);
+    for(const auto& tdata : training_data) {
+      tree.predict(tdata);
+      retrained.predict(tdata);
+    }
+    CHECK(tree.predict_stats().predictions == 4 * training_data.size());
+    CHECK(retrained.predict_stats().predictions == training_data.size());
+  }
+  tree.predict(training_data[0]);
+  CHECK(tree.predict_stats().predictions == 4 * training_data.size() + 1);
+
+  GML::TREE<std::string, GML::PREDICT_PROFILE> untrained;
+  CHECK(untrained.predict(training_data[0]).empty());
+  CHECK(untrained.predict_stats().predictions == 0);
+}
+
+TEST_CASE("Testing TREE node arena") {
+  GML::TREE<std::string> tree(training_data);
+  REQUIRE(!tree.dump_tree().is_leaf());
+
+  // Children split their parent's training rows and class counts between them
+  std::vector<GML::DECISION_NODE<std::string>> pending{tree.dump_tree()};
+  size_t nodes = 0;
+  while(!pending.empty()) {
+    auto node = pending.back();
+    pending.pop_back();
+    nodes += 1;
+    CHECK(node.id() < tree.node_count());
+    if(node.is_leaf())
+      continue;
+
+    auto parent = node.nodedata(), left = node.true_branch().nodedata(), right = node.false_branch().nodedata();
+    CHECK(left.samples() + right.samples() == parent.samples());
+    for(size_t class_id = 0; class_id < parent.counts.size(); ++class_id)
+      CHECK(left.counts[class_id] + right.counts[class_id] == parent.counts[class_id]);
+
+    for(const auto& tdata : node.true_branch().nodedata().tdatacol(training_data))
+      CHECK(node.question()(tdata));
+    for(const auto& tdata : node.false_branch().nodedata().tdatacol(training_data))
+      CHECK(!node.question()(tdata));
+
+    pending.push_back(node.true_branch());
+    pending.push_back(node.false_branch());
+  }
+  CHECK(nodes == tree.node_count());
+  CHECK(tree.dump_tree().nodedata().count() == training_data.count());
+
+  // Trees keep no copy of their rows unless asked to
+  CHECK(tree.dump_tree().nodedata().tdatacol().empty());
+  GML::TREE<std::string> keeping(training_data, {.keep_training_data = true});
+  CHECK(keeping.dump_tree().nodedata().tdatacol().size() == training_data.size());
+  CHECK(keeping.dump_tree().true_branch().nodedata().tdatacol().size() == tree.dump_tree().true_branch().nodedata().tdatacol(training_data).size());
+
+  // Pruning a copy leaves the nodes of the original alone, and node handles outlive moves
+  auto root = tree.dump_tree();
+  GML::TREE<std::string> pruned(tree);
+  pruned.prune(std::numeric_limits<double>::infinity());
+  CHECK(pruned.dump_tree().is_leaf());
+  CHECK(!root.is_leaf());
+
+  GML::TREE<std::string> moved(std::move(tree));
+  CHECK(!root.is_leaf());
+  CHECK(root.nodedata().samples() == training_data.size());
+}
+
+TEST_CASE("Testing TREE span predictions") {
+  GML::TDATA_COL<double> numeric_data;
+  for(int i = 1; i <= 12; ++i)
+    numeric_data.push_back({i <= 4 ? "Low"s : i <= 8 ? "Mid"s : "High"s, {(double) i, (double) (i % 3)}});
+
+  GML::TREE<double> tree(numeric_data);
+  std::vector<double> matrix; // Row-major, read in place
+  for(const auto& tdata : numeric_data)
+    matrix.insert(matrix.end(), tdata.begin(), tdata.end());
+
+  for(size_t row = 0; row < numeric_data.size(); ++row) {
+    std::span<const double, 2> features(matrix.data() + 2 * row, 2);
+    CHECK(tree.predict(features).id() == tree.predict(numeric_data[row]).id());
+    CHECK(tree.classes()[tree.predict_class(features)] == numeric_data[row].label);
+  }
+
+  // String rows are asked through the dictionaries, whether raw or already encoded
+  GML::TREE<std::string> string_tree(training_data);
+  GML::DATASET<std::string> dataset(training_data);
+  for(const auto& tdata : training_data) {
+    auto encoded = dataset.encode(tdata);
+    CHECK(string_tree.predict(std::span<const std::string>(tdata)).id() == string_tree.predict(tdata).id());
+    CHECK(string_tree.predict(std::span<const GML::CATEGORY_ID>(encoded)).id() == string_tree.predict(tdata).id());
+  }
+
+  GML::TDATA_COL<GML::FEATURE> mixed_data({
+      {"Apple"s, {3.0, "Green"s}},
+      {"Apple"s, {3.5, "Red"s}},
+      {"Grape"s, {1.0, "Red"s}},
+      {"Lemon"s, {3.2, "Yellow"s}}
+      });
+  GML::TREE<GML::FEATURE> mixed_tree(mixed_data);
+  for(const auto& tdata : mixed_data)
+    CHECK(mixed_tree.classes()[mixed_tree.predict_class(std::span<const GML::FEATURE>(tdata))] == tdata.label);
+}
+
+TEST_CASE("Testing TREE class probabilities") {
+  GML::TREE<std::string> tree(training_data, GML::TREE_OPTIONS{.max_depth = 1});
+  std::vector<float> probabilities(tree.classes().size());
+
+  for(const auto& tdata : training_data) {
+    tree.predict_proba(std::span<const std::string>(tdata), probabilities);
+    auto nodedata = tree.predict(tdata).nodedata();
+
+    float total = 0.0f;
+    for(size_t class_id = 0; class_id < probabilities.size(); ++class_id) {
+      CHECK(probabilities[class_id] == doctest::Approx((double) nodedata.counts[class_id] / nodedata.samples()));
+      CHECK(probabilities[class_id] == nodedata.probabilities[class_id]);
+      total += probabilities[class_id];
+    }
+    CHECK(total == doctest::Approx(1.0));
+    CHECK(nodedata.confidence()[tdata.label] > 0.0f);
+  }
+
+  // The depth-one leaf holding both apples also holds the lemon
+  auto leaf = tree.predict(GML::DATA<std::string>({"Yellow"s, "Big"s})).nodedata().confidence();
+  CHECK(leaf["Apple"] == doctest::Approx(2.0 / 3));
+  CHECK(leaf["Lemon"] == doctest::Approx(1.0 / 3));
+}
+
+TEST_CASE("Testing presorted split search") {
+  GML::TDATA_COL<GML::FEATURE> mixed_data;
+  const std::string colors[] = {"Red"s, "Green"s, "Yellow"s};
+  for(int i = 0; i < 60; ++i) {
+    double weight = (i * 37) % 23 + 0.5 * (i % 2);
+    int64_t seeds = (i * 11) % 7;
+    std::string label = weight + seeds > 14 ? "Big"s : (i % 3 == 0 ? "Round"s : "Small"s);
+    mixed_data.push_back({label, {weight, colors[(i * 5) % 3], seeds}});
+  }
+
+  GML::TREE<GML::FEATURE> tree(mixed_data);
+  GML::TREE<GML::FEATURE, GML::TRAIN_PROFILE> presorted(mixed_data, GML::TREE_OPTIONS{.presort = true});
+  REQUIRE(tree.node_count() > 3);
+  CHECK(presorted.node_count() == tree.node_count());
+
+  // Same questions in the same places, since both sweeps see the same thresholds in the same order
+  std::vector<std::pair<GML::DECISION_NODE<GML::FEATURE>, GML::DECISION_NODE<GML::FEATURE>>> pending{{tree.dump_tree(), presorted.dump_tree()}};
+  while(!pending.empty()) {
+    auto [node, other] = pending.back();
+    pending.pop_back();
+    REQUIRE(node.is_leaf() == other.is_leaf());
+    CHECK(node.nodedata().count() == other.nodedata().count());
+    if(node.is_leaf())
+      continue;
+
+    CHECK(node.question().column() == other.question().column());
+    CHECK(node.question().value() == other.question().value());
+    pending.push_back({node.true_branch(), other.true_branch()});
+    pending.push_back({node.false_branch(), other.false_branch()});
+  }
+}
+
+TEST_CASE("Testing sample and class weights") {
+  GML::TDATA_COL<double> numeric_data;
+  for(int i = 0; i < 40; ++i)
+    numeric_data.push_back({(i * 7) % 10 < 4 ? "Low"s : "High"s, {(double) ((i * 7) % 10), (double) ((i * 13) % 11)}});
+
+  // Bootstrap weights grow the tree the resampled copies would
+  std::vector<double> weights = GML::bootstrap_weights(numeric_data.size(), 7);
+  CHECK(std::accumulate(weights.begin(), weights.end(), 0.0) == numeric_data.size());
+  CHECK(GML::bootstrap_weights(numeric_data.size(), 7) == weights); // Same seed, same sample
+
+  GML::TDATA_COL<double> resampled;
+  for(size_t row = 0; row < numeric_data.size(); ++row)
+    for(int copy = 0; copy < weights[row]; ++copy)
+      resampled.push_back(numeric_data[row]);
+
+  GML::TREE<double> weighted(numeric_data, GML::TREE_OPTIONS(), weights);
+  GML::TREE<double> copied(resampled);
+  CHECK(weighted.node_count() == copied.node_count());
+  CHECK(weighted.dump_tree().nodedata().count() == resampled.count());
+  CHECK(weighted.pruning_path().leaves == copied.pruning_path().leaves);
+
+  // Rows drawn zero times are left out of every node
+  size_t drawn = std::count_if(weights.begin(), weights.end(), [](double weight) { return weight > 0; });
+  CHECK(weighted.dump_tree().nodedata().samples() == drawn);
+
+  for(const auto& tdata : numeric_data) {
+    auto weighted_leaf = weighted.predict(tdata).nodedata(), copied_leaf = copied.predict(tdata).nodedata();
+    CHECK(weighted_leaf.count() == copied_leaf.count());
+    CHECK(weighted_leaf.impurity == doctest::Approx(copied_leaf.impurity));
+  }
+
+  // A class weight of 3 counts like three copies of each of its rows
+  GML::TDATA_COL<double> tripled(numeric_data);
+  for(const auto& tdata : numeric_data)
+    if(tdata.label == "Low")
+      tripled.insert(tripled.end(), 2, tdata);
+
+  GML::TREE<double> class_weighted(numeric_data, GML::TREE_OPTIONS{.max_depth = 1, .class_weights = {{"Low", 3.0}}});
+  GML::TREE<double> class_copied(tripled, GML::TREE_OPTIONS{.max_depth = 1});
+  auto root = class_weighted.dump_tree().nodedata();
+  CHECK(root.weight == tripled.size());
+  CHECK(root.impurity == doctest::Approx(class_copied.dump_tree().nodedata().impurity));
+  CHECK(class_weighted.dump_tree().question().value() == class_copied.dump_tree().question().value());
+}
+
+TEST_CASE("Testing row and column subsampling") {
+  GML::TDATA_COL<double> wide_data;
+  for(int i = 0; i < 80; ++i) {
+    std::vector<double> features;
+    for(int column = 0; column < 8; ++column)
+      features.push_back((i * (column + 3)) % 17);
+    wide_data.push_back({(i * 5) % 17 < 8 ? "Low"s : "High"s, features});
+  }
+
+  auto columns_used = [](const GML::DECISION_NODE<double>& root) {
+    std::set<int> columns;
+    std::vector<GML::DECISION_NODE<double>> pending{root};
+    while(!pending.empty()) {
+      auto node = pending.back();
+      pending.pop_back();
+      if(node.is_leaf())
+        continue;
+      columns.insert(node.question().column());
+      pending.push_back(node.true_branch());
+      pending.push_back(node.false_branch());
+    }
+    return columns;
+  };
+
+  GML::TREE_OPTIONS options{.subsample = 0.5, .colsample_bytree = 0.25, .seed = 11};
+  GML::TREE<double> tree(wide_data, options), same(wide_data, options);
+  CHECK(tree.dump_tree().nodedata().samples() == 40);
+  CHECK(columns_used(tree.dump_tree()).size() <= 2);
+
+  // Equal seeds grow equal trees
+  CHECK(same.node_count() == tree.node_count());
+  CHECK(same.dump_tree().question().column() == tree.dump_tree().question().column());
+  CHECK(same.dump_tree().question().value() == tree.dump_tree().question().value());
+
+  SUBCASE("Every node searches its own columns") {
+    GML::TREE<double> one_column(wide_data, GML::TREE_OPTIONS{.max_features = 1, .seed = 3});
+    CHECK(one_column.dump_tree().nodedata().samples() == wide_data.size());
+    CHECK(columns_used(one_column.dump_tree()).size() > 1);
+
+    GML::TREE<double, GML::TRAIN_PROFILE> full(wide_data), sampled(wide_data, GML::TREE_OPTIONS{.colsample_bynode = 0.5});
+    CHECK(sampled.train_stats().candidates < full.train_stats().candidates);
+  }
+
+  SUBCASE("Without subsampling no engine is drawn from") {
+    GML::TREE<double> plain(wide_data), seeded(wide_data, GML::TREE_OPTIONS{.seed = 99});
+    CHECK(plain.node_count() == seeded.node_count());
+  }
+}
+
+TEST_CASE("Testing gradient-based one-side sampling") {
+  std::vector<double> gradients;
+  for(int i = 0; i < 100; ++i)
+    gradients.push_back((i % 2 ? -1.0 : 1.0) * ((i * 37) % 100) / 10.0);
+
+  std::vector<double> weights = GML::goss_weights(gradients, 0.2, 0.1, 5);
+  REQUIRE(weights.size() == gradients.size());
+  CHECK(weights == GML::goss_weights(gradients, 0.2, 0.1, 5));
+
+  // The 20 largest gradients are kept as they are, 10 of the other 80 stand for all of them
+  size_t kept = 0, sampled = 0;
+  for(size_t row = 0; row < gradients.size(); ++row) {
+    if(std::abs(gradients[row]) >= 8.0)
+      CHECK(weights[row] == 1.0);
+    kept += weights[row] == 1.0;
+    sampled += weights[row] == 8.0;
+  }
+  CHECK(kept == 20);
+  CHECK(sampled == 10);
+  CHECK(std::accumulate(weights.begin(), weights.end(), 0.0) == doctest::Approx(gradients.size()));
+
+  GML::TDATA_COL<double> numeric_data;
+  for(size_t i = 0; i < gradients.size(); ++i)
+    numeric_data.push_back({gradients[i] > 0 ? "Up"s : "Down"s, {gradients[i], (double) (i % 7)}});
+
+  GML::TREE<double> tree(numeric_data, GML::TREE_OPTIONS(), weights);
+  CHECK(tree.dump_tree().nodedata().samples() == kept + sampled);
+  CHECK(tree.dump_tree().nodedata().weight == doctest::Approx(gradients.size()));
+}
+
+TEST_CASE("Testing exclusive feature bundling") {
+  // Twelve one-hot columns with signed values, a sparse integer-valued column and a dense one
+  GML::TDATA_COL<double> sparse_data;
+  for(int i = 0; i < 96; ++i) {
+    std::vector<double> features(14, 0.0);
+    features[i % 12] = (i % 5) - 2.5 + 0.3 * (i % 3);
+    features[12] = i % 4 == 0 ? (double) (i % 9) : 0.0;
+    features[13] = (i * 7) % 11;
+    sparse_data.push_back({((i % 12) < 5) != (i % 4 == 0) ? "Yes"s : "No"s, features});
+  }
+
+  GML::DATASET<double> plain(sparse_data), bundled(sparse_data);
+  bundled.bundle_features();
+  REQUIRE(!bundled.bundles.empty());
+  CHECK(!bundled.bundled(13)); // Dense columns are searched alone
+
+  size_t bundled_columns = 0;
+  for(const auto& bundle : bundled.bundles) {
+    bundled_columns += bundle.columns.size();
+    CHECK(bundle.offsets.size() == bundle.columns.size() + 1);
+    for(size_t row = 0; row < sparse_data.size(); ++row) {
+      size_t nonzero = 0;
+      for(size_t column : bundle.columns)
+        nonzero += sparse_data[row][column] != 0.0;
+      CHECK(nonzero == (bundle.codes[row] != 0));
+    }
+  }
+  CHECK(bundled_columns >= 12);
+  CHECK(bundled.bundles.size() < bundled_columns);
+
+  // Bundled search finds the same best gain on any set of rows
+  std::mt19937_64 engine(1);
+  for(int trial = 0; trial < 20; ++trial) {
+    std::vector<size_t> rows(sparse_data.size());
+    std::iota(rows.begin(), rows.end(), 0);
+    GML::sample_in_place(rows, 10 + 4 * trial, engine);
+
+    auto [plain_gain, plain_question] = GML::find_best_split(plain, rows);
+    auto [bundled_gain, bundled_question] = GML::find_best_split(bundled, rows);
+    CHECK(bundled_gain == doctest::Approx(plain_gain));
+  }
+
+  GML::TREE<double> tree(sparse_data, GML::TREE_OPTIONS{.bundle_features = true});
+  for(const auto& tdata : sparse_data)
+    CHECK(tree.classes()[tree.predict_class(std::span<const double>(tdata))] == tdata.label);
+}
+
+TEST_CASE("Testing sparse input") {
+  // Forty columns, most of them zero on most rows
+  std::vector<std::vector<double>> dense_rows;
+  std::vector<std::string> labels;
+  for(int i = 0; i < 120; ++i) {
+    std::vector<double> features(40, 0.0);
+    features[i % 40] = 1.0 + i % 7;
+    features[(i * 3) % 40] = -0.5 * (i % 3 + 1);
+    features[39] = i % 2 ? 0.0 : i % 5;
+    dense_rows.push_back(features);
+    labels.push_back(features[3] != 0.0 || features[39] > 2.0 ? "Yes" : "No");
+  }
+
+  GML::TDATA_COL<double> training_data;
+  GML::CSR_MATRIX<double> csr;
+  for(size_t row = 0; row < dense_rows.size(); ++row) {
+    training_data.push_back({labels[row], dense_rows[row]});
+    csr.push_back(std::span<const double>(dense_rows[row]));
+  }
+
+  GML::CSC_MATRIX<double> csc;
+  for(size_t column = 0; column < 40; ++column) {
+    std::vector<double> values;
+    for(const auto& features : dense_rows)
+      values.push_back(features[column]);
+    csc.push_back(std::span<const double>(values));
+  }
+
+  CHECK(csr.size() == 120);
+  CHECK(csr.columns == 40);
+  CHECK(csc.col_size() == 40);
+  CHECK(csc.rows == 120);
+  CHECK(csr.indices.size() == csc.indices.size());
+
+  SUBCASE("Sparse rows read zero where they hold nothing") {
+    GML::SPARSE_ROW<double> row = csr.row(5);
+    for(size_t column = 0; column < 40; ++column)
+      CHECK(row[column] == dense_rows[5][column]);
+  }
+
+  SUBCASE("Zero-aware search matches the dense one") {
+    GML::DATASET<double> dense(training_data), sparse(csc, labels);
+    CHECK(sparse.labels == dense.labels);
+    CHECK(sparse.is_sparse(0));
+    CHECK(sparse.columns[0].empty()); // Its entries are all the dataset keeps of it
+    GML::DATASET<double> scattered(csc, labels, false);
+    CHECK(!scattered.is_sparse(0));
+    CHECK(scattered.columns[0] == dense.columns[0]);
+
+    std::mt19937_64 engine(3);
+    for(int trial = 0; trial < 20; ++trial) {
+      std::vector<size_t> rows(dense.size());
+      std::iota(rows.begin(), rows.end(), 0);
+      GML::sample_in_place(rows, 12 + 5 * trial, engine);
+
+      auto [dense_gain, dense_question] = GML::find_best_split(dense, rows);
+      auto [sparse_gain, sparse_question] = GML::find_best_split(sparse, rows);
+      CHECK(sparse_gain == doctest::Approx(dense_gain));
+
+      // Partitions routed through row marks keep the order of dense ones
+      std::vector<size_t> dense_rows = rows, sparse_rows = rows, scratch;
+      size_t dense_true = GML::partition<double>(dense, dense_rows, sparse_question, scratch);
+      CHECK(GML::partition<double>(sparse, sparse_rows, sparse_question, scratch) == dense_true);
+      CHECK(sparse_rows == dense_rows);
+    }
+  }
+
+  SUBCASE("CSC training needs one label per row and entries within the rows") {
+    std::vector<std::string> short_labels(labels.begin(), labels.end() - 1);
+    CHECK_THROWS_AS(GML::TREE<double>(csc, short_labels), std::invalid_argument);
+
+    GML::CSC_MATRIX<double> outside = csc;
+    outside.indices.back() = outside.rows;
+    CHECK_THROWS_AS(GML::DATASET<double>(outside, labels), std::invalid_argument);
+  }
+
+  SUBCASE("Trees trained on CSC columns predict CSR rows") {
+    GML::TREE<double> tree(csc, labels);
+    CHECK(tree.dump_tree().nodedata().tdatacol().empty());
+    CHECK(tree.node_count() == GML::TREE<double>(training_data).node_count());
+
+    std::vector<size_t> row_classes(csr.size());
+    tree.predict_class(csr, row_classes);
+
+    for(size_t row = 0; row < csr.size(); ++row) {
+      CHECK(tree.predict(csr.row(row)).id() == tree.predict(std::span<const double>(dense_rows[row])).id());
+      CHECK(tree.classes()[row_classes[row]] == labels[row]);
+    }
+
+    std::array<float, 2> probabilities{};
+    tree.predict_proba(csr.row(0), probabilities);
+    CHECK(probabilities[tree.predict_class(csr.row(0))] == 1.0f);
+  }
+}
+
+TEST_CASE("Testing missing values") {
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  const double inf = std::numeric_limits<double>::infinity();
+
+  // Missing readings of the first column mostly come from "Yes" rows
+  GML::TDATA_COL<double> missing_data;
+  for(int i = 0; i < 80; ++i) {
+    double reading = i % 5 == 0 ? nan : (i * 13) % 17;
+    bool yes = std::isnan(reading) ? i % 3 != 0 : reading > 9.0;
+    missing_data.push_back({yes ? "Yes"s : "No"s, {reading, double((i * 7) % 5)}});
+  }
+
+  auto filled = [&](double sentinel) {
+    GML::TDATA_COL<double> tdatacol = missing_data;
+    for(auto& tdata : tdatacol)
+      if(std::isnan(tdata[0]))
+        tdata[0] = sentinel;
+    return tdatacol;
+  };
+
+  SUBCASE("Missing values are tried on both sides of every threshold") {
+    GML::DATASET<double> dataset(missing_data), low(filled(-inf)), high(filled(inf));
+
+    std::mt19937_64 engine(5);
+    for(int trial = 0; trial < 20; ++trial) {
+      std::vector<size_t> rows(dataset.size());
+      std::iota(rows.begin(), rows.end(), 0);
+      GML::sample_in_place(rows, 10 + 3 * trial, engine);
+
+      double gain = GML::find_best_split(dataset, rows).first;
+      CHECK(gain == doctest::Approx(std::max(GML::find_best_split(low, rows).first, GML::find_best_split(high, rows).first)));
+    }
+  }
+
+  SUBCASE("Questions keep the better default direction") {
+    std::vector<size_t> rows(missing_data.size());
+    std::iota(rows.begin(), rows.end(), 0);
+    GML::DATASET<double> dataset(missing_data);
+
+    auto [gain, question] = GML::find_best_split(dataset, rows);
+    CHECK(question.column() == 0);
+    CHECK(question.value() == 9.0);
+    CHECK(question.missing_true() == false); // "Yes" rows answer false, so missing rows join them
+
+    auto [true_rows, false_rows] = GML::partition(dataset, rows, question);
+    for(size_t row : false_rows)
+      CHECK((std::isnan(missing_data[row][0]) || missing_data[row][0] > 9.0));
+
+    GML::QUESTION<double> low_missing(0, 4.0, true);
+    CHECK(low_missing.answer(nan));
+    CHECK(low_missing.answer(3.0));
+    CHECK(!low_missing.answer(5.0));
+    CHECK(!GML::QUESTION<double>(0, 4.0).answer(nan));
+  }
+
+  SUBCASE("Trees route missing values without imputation") {
+    GML::TREE<double> tree(missing_data), presorted(missing_data, GML::TREE_OPTIONS{.presort = true});
+    CHECK(tree.node_count() == presorted.node_count());
+
+    for(const auto& tdata : missing_data) {
+      std::span<const double> row(tdata);
+      CHECK(tree.predict_class(row) == presorted.predict_class(row));
+      if(std::isnan(tdata[0])) // Missing rows differ in label only, so they reach their majority
+        CHECK(tree.classes()[tree.predict_class(row)] == "Yes");
+      else
+        CHECK(tree.classes()[tree.predict_class(row)] == tdata.label);
+    }
+  }
+}
+
+TEST_CASE("Testing regression trees") {
+  // Targets follow a step in the first column, with noise from the second
+  GML::TDATA_COL<double> regression_data;
+  std::vector<double> targets;
+  for(int i = 0; i < 60; ++i) {
+    double x = (i * 7) % 30, noise = (i % 3) - 1.0;
+    regression_data.push_back({"", {x, noise}});
+    targets.push_back((x < 12 ? 5.0 : 20.0) + 0.5 * noise);
+  }
+
+  // Weighted impurity of both sides of q, from scratch
+  auto split_risk = [&](auto criterion, const GML::QUESTION<double>& q) {
+    using CRITERION = decltype(criterion);
+    typename CRITERION::STATS true_stats, false_stats;
+    for(size_t row = 0; row < regression_data.size(); ++row)
+      (q(regression_data[row]) ? true_stats : false_stats).add(targets[row], 1.0);
+    return CRITERION::impurity(true_stats) * true_stats.weight + CRITERION::impurity(false_stats) * false_stats.weight;
+  };
+
+  SUBCASE("Every training row needs a target") {
+    using MSE_TREE = GML::TREE<double, GML::NO_PROFILE, GML::MSE>;
+    std::span<const double> all(targets);
+    CHECK_THROWS_AS(MSE_TREE(regression_data, all.first(10)), std::invalid_argument);
+    CHECK_THROWS_AS(MSE_TREE(regression_data, std::span<const double>()), std::invalid_argument);
+    CHECK_NOTHROW(MSE_TREE(regression_data, all));
+  }
+
+  SUBCASE("Medians stay exact as rows are added") {
+    GML::MEDIAN_STATS stats;
+    std::vector<double> seen;
+    for(double target : targets) {
+      stats.add(target, 1.0);
+      seen.push_back(target);
+
+      std::vector<double> sorted = seen;
+      std::sort(sorted.begin(), sorted.end());
+      double median = sorted[(sorted.size() - 1) / 2], deviation = 0.0;
+      for(double value : sorted)
+        deviation += std::abs(value - median);
+
+      CHECK(stats.median() == median);
+      CHECK(stats.deviation() == doctest::Approx(deviation));
+    }
+  }
+
+  SUBCASE("Both criteria find the step") {
+    GML::DATASET<double> dataset(regression_data);
+    dataset.set_targets(targets);
+    std::vector<size_t> rows(dataset.size());
+    std::iota(rows.begin(), rows.end(), 0);
+
+    auto [mse_gain, mse_question] = GML::find_best_split<double, GML::BINARY, GML::MSE>(dataset, rows);
+    auto [mae_gain, mae_question] = GML::find_best_split<double, GML::BINARY, GML::MAE>(dataset, rows);
+    CHECK(mse_question.column() == 0);
+    CHECK(mse_question.value() == 11.0);
+    CHECK(mae_question.column() == 0);
+    CHECK(mae_question.value() == 11.0);
+
+    // Gains are the impurity drop every other threshold does no better than
+    GML::MSE::STATS total_moments;
+    GML::MAE::STATS total_medians;
+    for(double target : targets) {
+      total_moments.add(target, 1.0);
+      total_medians.add(target, 1.0);
+    }
+    CHECK(mse_gain == doctest::Approx(GML::MSE::impurity(total_moments) - split_risk(GML::MSE(), mse_question) / 60));
+    CHECK(mae_gain == doctest::Approx(GML::MAE::impurity(total_medians) - split_risk(GML::MAE(), mae_question) / 60));
+    for(double threshold = 0.0; threshold < 30.0; threshold += 1.0) {
+      CHECK(split_risk(GML::MSE(), GML::QUESTION<double>(0, threshold)) >= split_risk(GML::MSE(), mse_question) - 1e-9);
+      CHECK(split_risk(GML::MAE(), GML::QUESTION<double>(0, threshold)) >= split_risk(GML::MAE(), mae_question) - 1e-9);
+    }
+  }
+
+  SUBCASE("Leaves hold the mean or the median") {
+    GML::TREE<double, GML::NO_PROFILE, GML::MSE> mse_tree(regression_data, targets, GML::TREE_OPTIONS{.max_depth = 1});
+    GML::TREE<double, GML::NO_PROFILE, GML::MAE> mae_tree(regression_data, targets, GML::TREE_OPTIONS{.max_depth = 1});
+    CHECK(mse_tree.classes().empty());
+
+    double low[] = {3.0, 0.0}, high[] = {25.0, 1.0};
+    CHECK(mse_tree.predict_value(std::span<const double>(low)) == doctest::Approx(5.0));
+    CHECK(mse_tree.predict_value(std::span<const double>(high)) == doctest::Approx(20.0));
+    CHECK(mae_tree.predict_value(std::span<const double>(low)) == 5.0);
+    CHECK(mae_tree.predict_value(std::span<const double>(high)) == 20.0);
+
+    // Grown out, a tree fits every training target and its pruning path ends at the root's variance
+    GML::TREE<double, GML::NO_PROFILE, GML::MSE> full(regression_data, targets);
+    for(size_t row = 0; row < regression_data.size(); ++row)
+      CHECK(full.predict_value(std::span<const double>(regression_data[row])) == doctest::Approx(targets[row]));
+
+    GML::MSE::STATS total;
+    for(double target : targets)
+      total.add(target, 1.0);
+    CHECK(full.pruning_path().impurities.back() == doctest::Approx(GML::MSE::impurity(total)));
+  }
+
+  SUBCASE("Sparse columns train regression trees") {
+    GML::CSC_MATRIX<double> csc;
+    for(size_t column = 0; column < 2; ++column) {
+      std::vector<double> values;
+      for(const auto& tdata : regression_data)
+        values.push_back(tdata[column]);
+      csc.push_back(std::span<const double>(values));
+    }
+
+    GML::TREE<double, GML::NO_PROFILE, GML::MSE> sparse(csc, targets), dense(regression_data, targets);
+    for(size_t row = 0; row < regression_data.size(); ++row) {
+      std::span<const double> features(regression_data[row]);
+      CHECK(sparse.predict_value(features) == doctest::Approx(dense.predict_value(features)));
+    }
+  }
+}
+
+// Share of rows outside the majority class. It cannot score a split from one side, so split search sweeps twice.
+struct MISCLASSIFICATION {
+  using TARGET = size_t;
+  using STATS = GML::CLASS_STATS;
+  static constexpr bool classification = true;
+  static constexpr bool subtractive = false;
+
+  static double impurity(const STATS& stats) {
+    return stats.weight > 0 ? 1.0 - *std::max_element(stats.counts.begin(), stats.counts.end()) / stats.weight : 0.0;
+  }
+};
+
+TEST_CASE("Testing split criterion policies") {
+  static_assert(GML::SPLIT_CRITERION<GML::GINI> && GML::SPLIT_CRITERION<GML::ENTROPY> && GML::SPLIT_CRITERION<GML::LOG_LOSS>);
+  static_assert(GML::SPLIT_CRITERION<GML::MSE> && GML::SPLIT_CRITERION<GML::MAE>);
+  static_assert(GML::SPLIT_CRITERION<MISCLASSIFICATION>);
+  static_assert(!GML::SPLIT_CRITERION<int>);
+
+  // Three classes along the first column, the second one only noise
+  GML::TDATA_COL<double> criterion_data;
+  for(int i = 0; i < 45; ++i) {
+    double x = (i * 11) % 45;
+    std::string label = x < 14 ? "Low"s : x < 31 ? (i % 4 ? "Mid"s : "Low"s) : "High"s;
+    criterion_data.push_back({label, {x, double(i % 3)}});
+  }
+
+  GML::DATASET<double> dataset(criterion_data);
+  std::vector<size_t> rows(dataset.size());
+  std::iota(rows.begin(), rows.end(), 0);
+  GML::CLASS_STATS total = dataset.stats<GML::GINI>(rows);
+
+  // Best impurity decrease over every threshold of every column, from scratch
+  auto brute_force = [&](auto criterion) {
+    using CRITERION = decltype(criterion);
+    double best = 0.0;
+    for(size_t column = 0; column < 2; ++column) {
+      for(double threshold = 0.0; threshold < 45.0; threshold += 1.0) {
+        GML::CLASS_STATS true_side(dataset.classes.size()), false_side(dataset.classes.size());
+        for(size_t row : rows)
+          (criterion_data[row][column] <= threshold ? true_side : false_side).add(dataset.labels[row], 1.0);
+        if(true_side.weight == 0 || false_side.weight == 0)
+          continue;
+
+        double risk = CRITERION::impurity(true_side) * true_side.weight + CRITERION::impurity(false_side) * false_side.weight;
+        best = std::max(best, CRITERION::impurity(total) - risk / total.weight);
+      }
+    }
+    return best;
+  };
+
+  auto [gini_gain, gini_question] = GML::find_best_split<double, GML::BINARY, GML::GINI>(dataset, rows);
+  auto [entropy_gain, entropy_question] = GML::find_best_split<double, GML::BINARY, GML::ENTROPY>(dataset, rows);
+  auto [log_loss_gain, log_loss_question] = GML::find_best_split<double, GML::BINARY, GML::LOG_LOSS>(dataset, rows);
+  auto [custom_gain, custom_question] = GML::find_best_split<double, GML::BINARY, MISCLASSIFICATION>(dataset, rows);
+
+  CHECK(gini_gain == doctest::Approx(brute_force(GML::GINI())));
+  CHECK(entropy_gain == doctest::Approx(brute_force(GML::ENTROPY())));
+  CHECK(custom_gain == doctest::Approx(brute_force(MISCLASSIFICATION())));
+
+  // Log loss is entropy in nats
+  CHECK(GML::LOG_LOSS::impurity(total) == doctest::Approx(GML::ENTROPY::impurity(total) * std::log(2.0)));
+  CHECK(log_loss_gain == doctest::Approx(entropy_gain * std::log(2.0)));
+  CHECK(log_loss_question.column() == entropy_question.column());
+  CHECK(log_loss_question.value() == entropy_question.value());
+
+  GML::TREE<double, GML::NO_PROFILE, GML::ENTROPY> entropy_tree(criterion_data);
+  GML::TREE<double, GML::NO_PROFILE, MISCLASSIFICATION> custom_tree(criterion_data, GML::TREE_OPTIONS{.max_depth = 2});
+  CHECK(entropy_tree.dump_tree().nodedata().impurity == doctest::Approx(GML::ENTROPY::impurity(total)));
+  CHECK(custom_tree.dump_tree().nodedata().impurity == doctest::Approx(MISCLASSIFICATION::impurity(total)));
+  for(const auto& tdata : criterion_data)
+    CHECK(entropy_tree.classes()[entropy_tree.predict_class(std::span<const double>(tdata))] == tdata.label);
+}
+
+TEST_CASE("Testing k-ary categorical splits") {
+  GML::TDATA_COL<std::string> color_data;
+  const std::string colors[] = {"Red"s, "Blue"s, "Yellow"s, "Green"s, "Black"s, "White"s};
+  const std::string tastes[] = {"Sweet"s, "Sour"s, "Bitter"s, "Salty"s, "Umami"s, "Bland"s};
+  for(size_t i = 0; i < 6; ++i)
+    for(size_t repeat = 0; repeat < 3 + (i == 2); ++repeat)
+      color_data.push_back({tastes[i], {colors[i]}});
+
+  // A chain of five binary questions collapses into one node with a child per color
+  GML::TREE<std::string> binary(color_data);
+  GML::TREE<std::string> multiway(color_data, GML::TREE_OPTIONS{.mode = GML::MULTIPLE});
+  auto root = multiway.dump_tree();
+  REQUIRE(root.question().multiway());
+  CHECK(binary.node_count() == 11);
+  CHECK(multiway.node_count() == 7);
+  CHECK(root.branches() == 6);
+  for(size_t child = 0; child < root.branches(); ++child)
+    CHECK(root.branch(child).is_leaf());
+
+  for(const auto& tdata : color_data) {
+    CHECK(multiway.predict(tdata).nodedata().count()[tdata.label] == binary.predict(tdata).nodedata().count()[tdata.label]);
+    CHECK(multiway.predict(tdata).nodedata().count().size() == 1);
+  }
+
+  // Unseen categories join the heaviest child
+  CHECK(multiway.predict(GML::DATA<std::string>({"Purple"s})).nodedata().count()["Bitter"] == 4);
+
+  std::ostringstream printed;
+  printed << root.question();
+  CHECK(printed.str().find("Red: ") != std::string::npos);
+  CHECK(printed.str().find("others: ") != std::string::npos);
+
+  SUBCASE("Pruning treats every child as a leaf of the node") {
+    const GML::PRUNING_PATH& path = multiway.pruning_path();
+    CHECK(path.leaves.front() == 6);
+    CHECK(path.leaves.back() == 1);
+
+    GML::TREE<std::string> pruned = multiway;
+    pruned.prune(std::numeric_limits<double>::infinity());
+    CHECK(pruned.node_count() == 1);
+    CHECK(multiway.node_count() == 7);
+  }
+
+  SUBCASE("Binary splits take over past the category and node limits") {
+    GML::TREE<std::string> wide(color_data, GML::TREE_OPTIONS{.mode = GML::MULTIPLE, .max_branches = 5});
+    GML::TREE<std::string> budget(color_data, GML::TREE_OPTIONS{.max_nodes = 5, .mode = GML::MULTIPLE});
+    CHECK(!wide.dump_tree().question().multiway());
+    CHECK(!budget.dump_tree().question().multiway());
+    CHECK(budget.node_count() <= 5);
+  }
+
+  SUBCASE("Presorted columns follow every child") {
+    GML::TDATA_COL<GML::FEATURE> mixed_data;
+    for(int i = 0; i < 60; ++i) {
+      double weight = (i * 37) % 23;
+      size_t color = (i * 7) % 5;
+      std::string label = color < 2 ? tastes[color] : (weight < 8 + 3 * color ? "Light"s : "Heavy"s);
+      mixed_data.push_back({label, {weight, colors[color]}});
+    }
+
+    GML::TREE_OPTIONS options{.mode = GML::MULTIPLE};
+    GML::TREE<GML::FEATURE> tree(mixed_data, options);
+    options.presort = true;
+    GML::TREE<GML::FEATURE> presorted(mixed_data, options);
+    REQUIRE(tree.dump_tree().question().multiway());
+    CHECK(presorted.node_count() == tree.node_count());
+
+    std::vector<std::pair<GML::DECISION_NODE<GML::FEATURE>, GML::DECISION_NODE<GML::FEATURE>>> pending{{tree.dump_tree(), presorted.dump_tree()}};
+    while(!pending.empty()) {
+      auto [node, other] = pending.back();
+      pending.pop_back();
+      REQUIRE(node.branches() == other.branches());
+      CHECK(node.nodedata().count() == other.nodedata().count());
+      for(size_t child = 0; child < node.branches(); ++child)
+        pending.push_back({node.branch(child), other.branch(child)});
+    }
+
+    for(const auto& tdata : mixed_data)
+      CHECK(tree.predict(tdata).nodedata().count().size() == 1);
+  }
+}
+
+TEST_CASE("Testing feature importances") {
+  // The label follows the first column, the second one only near the boundary, the third never
+  GML::TDATA_COL<double> importance_data;
+  for(int i = 0; i < 80; ++i) {
+    double x = (i * 13) % 80, y = (i * 7) % 5, noise = (i * 29) % 11;
+    std::string label = x < 30 ? "Low"s : x < 50 ? (y < 2 ? "Low"s : "High"s) : "High"s;
+    importance_data.push_back({label, {x, y, noise}});
+  }
+
+  GML::TREE<double> tree(importance_data);
+  std::span<const double> gains = tree.gain_importances();
+  std::span<const size_t> counts = tree.split_counts();
+  REQUIRE(gains.size() == 3);
+  CHECK(gains[0] > gains[1]);
+  CHECK(gains[2] == 0.0);
+
+  // Splits and their gains, counted again from the nodes
+  auto recount = [](const auto& trained) {
+    std::vector<double> node_gains(3, 0.0);
+    std::vector<size_t> node_counts(3, 0);
+    std::vector<GML::DECISION_NODE<double>> pending{trained.dump_tree()};
+    while(!pending.empty()) {
+      auto node = pending.back();
+      pending.pop_back();
+      if(node.is_leaf())
+        continue;
+
+      auto parent = node.nodedata();
+      double gain = parent.impurity * parent.weight;
+      for(size_t child = 0; child < node.branches(); ++child) {
+        gain -= node.branch(child).nodedata().impurity * node.branch(child).nodedata().weight;
+        pending.push_back(node.branch(child));
+      }
+      node_gains[node.question().column()] += gain / trained.dump_tree().nodedata().weight;
+      node_counts[node.question().column()] += 1;
+    }
+    return std::pair{node_gains, node_counts};
+  };
+
+  auto [node_gains, node_counts] = recount(tree);
+  for(size_t column = 0; column < 3; ++column) {
+    CHECK(gains[column] == doctest::Approx(node_gains[column]));
+    CHECK(counts[column] == node_counts[column]);
+  }
+  CHECK(std::accumulate(counts.begin(), counts.end(), size_t(0)) == (tree.node_count() - 1) / 2);
+  CHECK(std::accumulate(gains.begin(), gains.end(), 0.0) == doctest::Approx(tree.dump_tree().nodedata().impurity - tree.pruning_path().impurities.front()));
+
+  SUBCASE("Pruning drops the splits it collapses") {
+    const GML::PRUNING_PATH& path = tree.pruning_path();
+    REQUIRE(path.alphas.size() > 2);
+    GML::TREE<double> pruned = tree;
+    pruned.prune(path.alphas[1]);
+
+    auto [pruned_gains, pruned_counts] = recount(pruned);
+    for(size_t column = 0; column < 3; ++column) {
+      CHECK(pruned.gain_importances()[column] == doctest::Approx(pruned_gains[column]));
+      CHECK(pruned.split_counts()[column] == pruned_counts[column]);
+    }
+    CHECK(std::accumulate(pruned_counts.begin(), pruned_counts.end(), size_t(0)) < std::accumulate(counts.begin(), counts.end(), size_t(0)));
+
+    pruned.prune(std::numeric_limits<double>::infinity());
+    CHECK(pruned.gain_importances()[0] == 0.0);
+    CHECK(pruned.split_counts()[0] == 0);
+  }
+
+  SUBCASE("Batch prediction and permutation importance spread over threads") {
+    std::vector<size_t> serial(importance_data.size()), threaded(importance_data.size());
+    tree.predict_class(importance_data, serial);
+    tree.predict_class(importance_data, threaded, 4);
+    CHECK(serial == threaded);
+    for(size_t r = 0; r < importance_data.size(); ++r)
+      CHECK(serial[r] == tree.predict_class(std::span<const double>(importance_data[r])));
+
+    std::vector<double> single = tree.permutation_importance(importance_data, {}, 4, 7, 1);
+    std::vector<double> parallel = tree.permutation_importance(importance_data, {}, 4, 7, 3);
+    CHECK(single == parallel);
+    CHECK(single[0] > single[1]);
+    CHECK(single[0] > 0.2);
+    CHECK(single[2] == 0.0); // Never asked, so shuffling it changes no prediction
+
+    std::vector<double> targets;
+    for(const auto& tdata : importance_data)
+      targets.push_back(tdata[0] / 10 + (tdata[1] < 2));
+    GML::TREE<double, GML::NO_PROFILE, GML::MSE> regression(importance_data, targets);
+    std::vector<double> values(importance_data.size());
+    regression.predict_value(importance_data, values, 2);
+    CHECK(values[5] == regression.predict_value(std::span<const double>(importance_data[5])));
+
+    std::vector<double> rises = regression.permutation_importance(importance_data, targets);
+    CHECK(rises[0] > rises[1]);
+    CHECK(rises[1] > 0.0);
+
+    // Regression scores against one target per row; classification reads the labels instead
+    CHECK_THROWS_AS(regression.permutation_importance(importance_data), std::invalid_argument);
+    CHECK_THROWS_AS(regression.permutation_importance(importance_data, std::span(targets).first(3)), std::invalid_argument);
+    CHECK_THROWS_AS(tree.permutation_importance(importance_data, targets), std::invalid_argument);
+  }
+}
+
+TEST_CASE("Testing TreeSHAP explanations") {
+  // Columns are asked several times along a path, so TreeSHAP has to take them off the path again
+  GML::TDATA_COL<double> shap_data;
+  for(int i = 0; i < 90; ++i) {
+    double a = (i * 17) % 30, b = (i * 7) % 9, c = (i * 11) % 4, d = (i * 5) % 7;
+    std::string label = a < 10 ? (b < 4 ? "Red"s : "Blue"s) : a < 20 ? (c < 2 ? "Green"s : "Red"s) : (b + d < 8 ? "Blue"s : "Green"s);
+    shap_data.push_back({label, {a, b, c, d}});
+  }
+
+  GML::TREE<double> tree(shap_data, GML::TREE_OPTIONS{.max_depth = 6});
+  const size_t columns = 4, outputs = tree.shap_outputs();
+  REQUIRE(outputs == 3);
+
+  // Shapley values from every subset of columns, unknown columns averaged over children by their weight
+  auto brute_force = [&](const auto& trained, const GML::DATA<double>& row, size_t output) {
+    auto expectation = [&](auto&& self, const GML::DECISION_NODE<double>& node, unsigned known) -> double {
+      if(node.is_leaf()) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(trained)>, GML::TREE<double>>)
+          return node.nodedata().probabilities[output];
+        else
+          return node.nodedata().value;
+      }
+      if(known >> node.question().column() & 1)
+        return self(self, node.question()(row) ? node.true_branch() : node.false_branch(), known);
+
+      double total = 0.0;
+      for(size_t child = 0; child < node.branches(); ++child)
+        total += node.branch(child).nodedata().weight / node.nodedata().weight * self(self, node.branch(child), known);
+      return total;
+    };
+
+    std::vector<double> phi(columns, 0.0);
+    for(size_t column = 0; column < columns; ++column) {
+      for(unsigned subset = 0; subset < (1u << columns); ++subset) {
+        if(subset >> column & 1)
+          continue;
+        size_t size = std::popcount(subset);
+        double share = std::tgamma(size + 1) * std::tgamma(columns - size) / std::tgamma(columns + 1);
+        phi[column] += share * (expectation(expectation, trained.dump_tree(), subset | 1u << column) - expectation(expectation, trained.dump_tree(), subset));
+      }
+    }
+    return phi;
+  };
+
+  std::vector<double> contributions((columns + 1) * outputs);
+  for(size_t r = 0; r < shap_data.size(); r += 7) {
+    const auto& row = shap_data[r];
+    tree.shap_values(std::span<const double>(row), contributions);
+
+    auto probabilities = tree.predict(row).nodedata().probabilities;
+    for(size_t output = 0; output < outputs; ++output) {
+      std::vector<double> phi = brute_force(tree, row, output);
+      double total = contributions[columns * outputs + output];
+      for(size_t column = 0; column < columns; ++column) {
+        CHECK(contributions[column * outputs + output] == doctest::Approx(phi[column]));
+        total += contributions[column * outputs + output];
+      }
+      CHECK(total == doctest::Approx(probabilities[output]));
+      CHECK(contributions[columns * outputs + output] == doctest::Approx(tree.dump_tree().nodedata().probabilities[output]));
+    }
+  }
+
+  SUBCASE("Batches match single rows on any thread count") {
+    std::vector<double> batch(shap_data.size() * contributions.size()), threaded(batch.size());
+    tree.shap_values(shap_data, batch);
+    tree.shap_values(shap_data, threaded, 3);
+    CHECK(batch == threaded);
+
+    tree.shap_values(std::span<const double>(shap_data[11]), contributions);
+    for(size_t i = 0; i < contributions.size(); ++i)
+      CHECK(batch[11 * contributions.size() + i] == doctest::Approx(contributions[i]));
+  }
+
+  SUBCASE("Regression trees and ensembles") {
+    std::vector<double> targets;
+    for(const auto& tdata : shap_data)
+      targets.push_back(tdata[0] * (tdata[1] < 4) + tdata[2] * tdata[3]);
+    GML::TREE<double, GML::NO_PROFILE, GML::MSE> regression(shap_data, targets, GML::TREE_OPTIONS{.max_depth = 5});
+
+    std::vector<double> values(columns + 1);
+    regression.shap_values(std::span<const double>(shap_data[4]), values);
+    std::vector<double> phi = brute_force(regression, shap_data[4], 0);
+    for(size_t column = 0; column < columns; ++column)
+      CHECK(values[column] == doctest::Approx(phi[column]));
+    CHECK(std::accumulate(values.begin(), values.end(), 0.0) == doctest::Approx(regression.predict_value(std::span<const double>(shap_data[4]))));
+
+    // Shapley values are linear in the model, so a forest's are the mean of its trees'
+    std::vector<GML::TREE<double>> forest;
+    for(uint64_t seed = 0; seed < 3; ++seed)
+      forest.emplace_back(shap_data, GML::TREE_OPTIONS{.max_depth = 4}, GML::bootstrap_weights(shap_data.size(), seed));
+
+    std::vector<double> forest_contributions(contributions.size()), batch(shap_data.size() * contributions.size());
+    GML::shap_values(forest, std::span<const double>(shap_data[9]), std::span<double>(forest_contributions));
+    GML::shap_values(forest, shap_data, batch, 2);
+    for(size_t output = 0; output < outputs; ++output) {
+      double predicted = 0.0, total = 0.0;
+      for(const auto& member : forest)
+        predicted += member.predict(shap_data[9]).nodedata().probabilities[output] / forest.size();
+      for(size_t column = 0; column <= columns; ++column) {
+        total += forest_contributions[column * outputs + output];
+        CHECK(batch[9 * contributions.size() + column * outputs + output] == doctest::Approx(forest_contributions[column * outputs + output]));
+      }
+      CHECK(total == doctest::Approx(predicted));
+    }
+  }
+}
+
+TEST_CASE("Testing model hot-swap") {
+  // Counts live models, so the test sees exactly when a retired one is freed
+  struct COUNTED {
+    std::shared_ptr<std::atomic<int>> alive;
+    std::vector<int> payload;
+
+    COUNTED(std::shared_ptr<std::atomic<int>> counter, int version) : alive{std::move(counter)}, payload(64, version) { *alive += 1; }
+    COUNTED(const COUNTED& other) : alive{other.alive}, payload{other.payload} { *alive += 1; }
+    ~COUNTED() { *alive -= 1; }
+  };
+
+  auto alive = std::make_shared<std::atomic<int>>(0);
+  {
+    GML::MODEL_HANDLE<COUNTED> handle(COUNTED(alive, 0));
+    CHECK(*alive == 1);
+    CHECK(handle.read([](const COUNTED& model) { return model.payload[0]; }) == 0);
+
+    // Nothing reads, so the old model goes at once
+    handle.publish(COUNTED(alive, 1));
+    CHECK(*alive == 1);
+    CHECK(handle.epoch() == 1);
+
+    // A read in flight keeps the model it started with, even through nested reads and two publishes
+    handle.read([&](const COUNTED& model) {
+      handle.publish(COUNTED(alive, 2));
+      CHECK(handle.read([](const COUNTED& newest) { return newest.payload[0]; }) == 2);
+      handle.publish(COUNTED(alive, 3));
+      CHECK(handle.reclaim() == 2);
+      CHECK(model.payload[0] == 1);
+      CHECK(*alive == 3);
+    });
+    CHECK(handle.reclaim() == 0);
+    CHECK(*alive == 1);
+
+    // Reading another handle inside a read leaves this thread's slot on the first one pinned
+    GML::MODEL_HANDLE<COUNTED> other(COUNTED(alive, 10));
+    handle.read([&](const COUNTED& model) {
+      CHECK(other.read([](const COUNTED& inner) { return inner.payload[0]; }) == 10);
+      handle.publish(COUNTED(alive, 4));
+      CHECK(handle.reclaim() == 1);
+      CHECK(model.payload[0] == 3);
+    });
+    CHECK(handle.reclaim() == 0);
+    CHECK(*alive == 2);
+    CHECK(handle.readers() == 1);
+
+    // A thread alternating between more handles than it caches still reads each one's model,
+    // and leaves none of its slots behind when it exits
+    std::vector<std::unique_ptr<GML::MODEL_HANDLE<COUNTED>>> handles;
+    for(int version = 0; version < 12; ++version)
+      handles.push_back(std::make_unique<GML::MODEL_HANDLE<COUNTED>>(COUNTED(alive, 100 + version)));
+    std::thread([&] {
+      for(int round = 0; round < 3; ++round)
+        for(size_t index = 0; index < handles.size(); ++index)
+          CHECK(handles[index]->read([](const COUNTED& model) { return model.payload[0]; }) == 100 + (int) index);
+      CHECK(handles[0]->readers() == 1);
+    }).join();
+    for(const auto& alternated : handles)
+      CHECK(alternated->readers() == 0);
+  }
+  CHECK(*alive == 0);
+
+  SUBCASE("Readers never see a freed tree while a writer swaps") {
+    GML::TREE<std::string> first(training_data, GML::TREE_OPTIONS{.max_depth = 1}), second(training_data);
+    GML::MODEL_HANDLE<GML::TREE<std::string>> handle(first);
+    std::vector<size_t> node_counts{first.node_count(), second.node_count()};
+
+    std::atomic<bool> done{false};
+    std::atomic<size_t> reads{0}, mismatches{0};
+    std::vector<std::thread> readers;
+    for(int reader = 0; reader < 3; ++reader) {
+      readers.emplace_back([&] {
+        while(!done.load()) {
+          handle.read([&](const GML::TREE<std::string>& tree) {
+            bool known = tree.node_count() == node_counts[0] || tree.node_count() == node_counts[1];
+            mismatches += !known || tree.predict(training_data[0]).nodedata().empty();
+          });
+          reads += 1;
+        }
+      });
+    }
+
+    for(int version = 0; version < 200; ++version)
+      handle.publish(version % 2 ? first : second);
+    while(reads.load() < 1000)
+      std::this_thread::yield();
+    done = true;
+    for(std::thread& reader : readers)
+      reader.join();
+
+    CHECK(mismatches == 0);
+    CHECK(handle.epoch() == 200);
+    CHECK(handle.reclaim() == 0);
+    CHECK(handle.readers() == 0);
+  }
+}
+
+TEST_CASE("Testing streaming Hoeffding trees") {
+  std::mt19937 engine(11);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  auto draw = [&]() {
+    double x = uniform(engine), y = uniform(engine), noise = uniform(engine);
+    std::string label = x < 0.5 ? (y < 0.3 ? "A"s : "B"s) : "C"s;
+    return GML::TDATA<double>{label, {x, y, noise}};
+  };
+
+  GML::HOEFFDING_TREE<double> stream;
+  for(int i = 0; i < 20000; ++i)
+    stream.update(draw());
+  REQUIRE(stream.node_count() > 1);
+  CHECK(stream.node_count() == 2 * stream.leaf_count() - 1);
+
+  // The export predicts like a batch tree and carries the weight of every row seen
+  GML::TREE<double> tree = stream.to_tree();
+  CHECK(tree.node_count() == stream.node_count());
+  CHECK(tree.classes() == stream.classes());
+  CHECK(tree.dump_tree().nodedata().weight == doctest::Approx(20000));
+  CHECK(tree.gain_importances()[0] > tree.gain_importances()[2]);
+
+  size_t correct = 0;
+  for(int i = 0; i < 2000; ++i) {
+    GML::TDATA<double> tdata = draw();
+    correct += tree.classes()[tree.predict_class(std::span<const double>(tdata))] == tdata.label;
+  }
+  CHECK(correct > 1900);
+
+  SUBCASE("Leaves stop learning at the budget") {
+    GML::HOEFFDING_TREE<double> bounded(GML::HOEFFDING_OPTIONS{.grace_period = 50, .max_leaves = 3});
+    for(int i = 0; i < 20000; ++i)
+      bounded.update(draw());
+    CHECK(bounded.leaf_count() == 3);
+    CHECK(bounded.to_tree().node_count() == 5);
+
+    GML::HOEFFDING_TREE<double> stump(GML::HOEFFDING_OPTIONS{.max_depth = 1});
+    for(int i = 0; i < 5000; ++i)
+      stump.update(draw());
+    CHECK(stump.node_count() == 3);
+  }
+
+  SUBCASE("Categorical streams") {
+    const std::string colors[] = {"Red"s, "Green"s, "Blue"s, "Black"s};
+    GML::HOEFFDING_TREE<std::string, GML::ENTROPY> colored(GML::HOEFFDING_OPTIONS{.grace_period = 100});
+    for(int i = 0; i < 5000; ++i) {
+      const std::string& color = colors[i % 4];
+      colored.update({color == "Red" || color == "Blue" ? "Warm"s : "Cold"s, {color, i % 3 ? "Big"s : "Small"s}});
+    }
+
+    GML::TREE<std::string, GML::NO_PROFILE, GML::ENTROPY> exported = colored.to_tree();
+    REQUIRE(exported.node_count() > 1);
+    for(const std::string& color : colors) {
+      auto leaf = exported.predict(GML::DATA<std::string>({color, "Big"s})).nodedata();
+      CHECK(leaf.confidence()[color == "Red" || color == "Blue" ? "Warm"s : "Cold"s] == doctest::Approx(1.0f));
+    }
+    CHECK(!exported.predict(GML::DATA<std::string>({"Purple"s, "Big"s})).nodedata().empty());
+
+    // The export keeps its dictionaries while the stream meets new categories
+    colored.update({"Cold"s, {"Purple"s, "Big"s}});
+    CHECK(exported.predict(GML::DATA<std::string>({"Purple"s, "Big"s})).nodedata().samples() == 0);
+  }
+}